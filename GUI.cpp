@@ -40,15 +40,15 @@ const FPC::Color& PositionCache::get_cached_player() const {
 }
 
 std::string Painter::get_path_to_piece_image(int x, int y) {
-    if (!m_board.get_board()[x][y].piece.has_value() || !m_board.get_board()[x][y].color.has_value())
+    if (!m_board.get_board()[x][y].piece().has_value() || !m_board.get_board()[x][y].color().has_value())
         return "assets/grey_square.svg";
 
     std::string path = "assets/shapes/";
 
-    if (!m_board.player_exists(m_board.get_board()[x][y].color.value())) {
+    if (!m_board.player_exists(m_board.get_board()[x][y].color().value())) {
         path.append("grey");
     } else {
-        switch (m_board.get_board()[x][y].color.value()) {
+        switch (m_board.get_board()[x][y].color().value()) {
             case FPC::Color::Red:
                 path.append("r");
                 break;
@@ -64,7 +64,7 @@ std::string Painter::get_path_to_piece_image(int x, int y) {
         }
     }
 
-    switch (m_board.get_board()[x][y].piece.value()) {
+    switch (m_board.get_board()[x][y].piece().value()) {
         case FPC::Piece::Rook:
             path.append("R.svg");
             break;
@@ -0,0 +1,161 @@
+#include "library.h"
+#include "mcts.h"
+#include "search.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void print_usage() {
+    std::cout << "Usage: analyze [--depth <plies>] [--nodes <count>] [--time <milliseconds>] [--hash <megabytes>] [--max-n | --mcts]\n"
+              << "               [--threads <count>] [--cores <core>,...] [--speedup] [--network <file>] [--position <position>]\n"
+              << "               [--moves <move>...]\n"
+              << "Searches the initial or given position, after playing the given moves, and prints every completed iteration.\n"
+              << "Uses paranoid search unless --max-n is given, and searches 5 plies deep if no limit is given.\n"
+              << "Searches with one thread unless --threads is given, and --cores binds the threads to the listed cores.\n"
+              << "With --speedup, the search is first run on one thread to compare the time taken to reach the same depth.\n"
+              << "With --mcts, Monte Carlo tree search is used instead, for --nodes playouts or, by default, one second.\n"
+              << "With --network, positions are evaluated by the network in the given file rather than by the built-in terms.\n";
+}
+
+int main(int argc, char** argv) {
+    FPC::SearchLimits limits;
+    std::size_t hash_megabytes = 16;
+    bool max_n = false;
+    bool mcts = false;
+    int thread_count = 1;
+    std::vector<int> cores;
+    bool measure_speedup = false;
+    FPC::Network network; // Must outlive 'game'.
+    std::string network_path;
+    FPC::GameState game;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if ((argument == "--depth" || argument == "--nodes" || argument == "--time" || argument == "--hash" || argument == "--threads") && i + 1 < argc) {
+            try {
+                const auto value = std::stoull(argv[++i]);
+                if (argument == "--threads")
+                    thread_count = static_cast<int>(value);
+                else if (argument == "--depth")
+                    limits.depth = static_cast<int>(value);
+                else if (argument == "--nodes")
+                    limits.nodes = value;
+                else if (argument == "--time")
+                    limits.time = std::chrono::milliseconds(value);
+                else
+                    hash_megabytes = value;
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else if (argument == "--cores" && i + 1 < argc) {
+            std::istringstream list(argv[++i]);
+            std::string core;
+            try {
+                while (std::getline(list, core, ','))
+                    cores.push_back(std::stoi(core));
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else if (argument == "--speedup") {
+            measure_speedup = true;
+        } else if (argument == "--max-n") {
+            max_n = true;
+        } else if (argument == "--mcts") {
+            mcts = true;
+        } else if (argument == "--network" && i + 1 < argc) {
+            network_path = argv[++i];
+        } else if (argument == "--position" && i + 1 < argc) {
+            if (!FPC::parse_position(game, argv[++i])) {
+                std::cout << "Invalid position: " << argv[i] << '\n';
+                return 1;
+            }
+        } else if (argument == "--moves") {
+            for (++i; i < argc; ++i) {
+                const auto move = FPC::parse_move(game, argv[i]);
+                if (!move.has_value()) {
+                    std::cout << "Illegal move: " << argv[i] << '\n';
+                    return 1;
+                }
+                game.make_move(move.value());
+                game.advance_turn();
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (!network_path.empty()) {
+        if (!network.load(network_path)) {
+            std::cout << "Invalid network: " << network_path << '\n';
+            return 1;
+        }
+        game.set_network(&network);
+    }
+
+    if (mcts) {
+        FPC::MonteCarloTreeSearch search;
+        search.set_thread_count(thread_count);
+        FPC::MonteCarloLimits mcts_limits;
+        mcts_limits.playouts = limits.nodes;
+        mcts_limits.time = limits.nodes == 0 && limits.time.count() == 0 ? std::chrono::milliseconds(1000) : limits.time;
+        const auto result = search.run(game, mcts_limits);
+        if (result.best_move.is_null()) {
+            std::cout << "The game is over.\n";
+            return 0;
+        }
+        std::cout << "Playouts: " << result.playouts << " (" << result.playouts * 1000 / std::max<std::int64_t>(result.time.count(), 1) << " per second)\n"
+                  << "Tree size: " << result.tree_size << " nodes\n"
+                  << "Rewards:";
+        for (const auto reward : result.rewards)
+            std::cout << ' ' << reward;
+        std::cout << "\nPrincipal variation:";
+        for (const auto& move : result.principal_variation)
+            std::cout << ' ' << FPC::move_to_string(move);
+        std::cout << "\nBest move: " << FPC::move_to_string(result.best_move) << '\n';
+        return 0;
+    }
+
+    if (limits.depth == 0 && limits.nodes == 0 && limits.time.count() == 0)
+        limits.depth = 5;
+
+    FPC::Search search(hash_megabytes);
+    search.set_algorithm(max_n ? FPC::SearchAlgorithm::MaxN : FPC::SearchAlgorithm::Paranoid);
+    search.set_thread_affinity(cores);
+
+    std::chrono::milliseconds single_thread_time {0};
+    if (measure_speedup) {
+        search.set_thread_count(1);
+        const auto result = search.run(game, limits);
+        single_thread_time = result.time;
+        std::cout << "One thread: depth " << result.depth << " nodes " << result.nodes << " time " << result.time.count() << " ms\n";
+        search.get_transposition_table().clear();
+    }
+
+    search.set_thread_count(thread_count);
+    search.set_iteration_callback([](const FPC::SearchResult& result) {
+        std::cout << "depth " << result.depth << " score " << result.score << " nodes " << result.nodes << " time " << result.time.count()
+                  << " nps " << result.nodes * 1000 / std::max<std::int64_t>(result.time.count(), 1) << " pv";
+        for (const auto& move : result.principal_variation)
+            std::cout << ' ' << FPC::move_to_string(move);
+        std::cout << '\n';
+    });
+
+    const auto result = search.run(game, limits);
+    if (result.best_move.is_null()) {
+        std::cout << "The game is over.\n";
+        return 0;
+    }
+    std::cout << "Best move: " << FPC::move_to_string(result.best_move) << '\n';
+
+    const auto milliseconds = std::max<std::int64_t>(result.time.count(), 1);
+    for (std::size_t i = 0; i < result.thread_nodes.size(); ++i)
+        std::cout << "Thread " << i << ": " << result.thread_nodes[i] << " nodes, " << result.thread_nodes[i] * 1000 / milliseconds << " nodes per second\n";
+    if (measure_speedup) {
+        std::cout << "Speedup over one thread at depth " << result.depth << ": "
+                  << static_cast<double>(std::max<std::int64_t>(single_thread_time.count(), 1)) / milliseconds << '\n';
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "library.h"
+#include "nnue.h"
+#include "search.h"
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void print_usage() {
+    std::cout << "Usage: bench [--network <file>] [--seed <seed>] [--positions <count>] [--rounds <count>] [--save <file>]\n"
+              << "Measures how fast positions are evaluated, with the network in the given file and with the built-in terms, and how\n"
+              << "much keeping the network's accumulators up to date slows down making and taking back moves. Without --network, a\n"
+              << "network with random weights is made from --seed, which --save writes to a file. The positions, 10000 by default,\n"
+              << "come from random games, and every measurement goes over all of them --rounds times (100 by default).\n";
+}
+
+// Every position of random games, one after another, until there are enough of them.
+static std::vector<FPC::GameState> random_positions(std::size_t count, std::uint64_t seed) {
+    std::vector<FPC::GameState> positions;
+    positions.reserve(count);
+    std::uint64_t state = seed | 1;
+    FPC::GameState game;
+    FPC::MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    while (positions.size() < count) {
+        if (game.get_current_players().size() <= 1 || moves.empty()) {
+            game.reset();
+            moves.clear();
+            game.generate_legal_moves(game.get_current_player(), moves);
+        }
+        positions.push_back(game);
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        game.make_move(moves[static_cast<int>(((state * 0x2545f4914f6cdd1d) >> 32) % moves.size())]);
+        game.advance_turn(moves);
+    }
+    return positions;
+}
+
+// Calls 'work' on every position 'rounds' times, and returns how many calls that makes per second.
+template<typename Work>
+static double per_second(const std::vector<FPC::GameState>& positions, int rounds, Work work) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (const auto& game : positions)
+            work(game);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(positions.size()) * rounds / std::max(elapsed.count(), 1e-9);
+}
+
+int main(int argc, char** argv) {
+    std::string network_path;
+    std::string save_path;
+    std::uint64_t seed = 1;
+    std::size_t position_count = 10000;
+    int rounds = 100;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if ((argument == "--seed" || argument == "--positions" || argument == "--rounds") && i + 1 < argc) {
+            try {
+                const auto value = std::stoull(argv[++i]);
+                if (argument == "--seed")
+                    seed = value;
+                else if (argument == "--positions")
+                    position_count = value;
+                else
+                    rounds = static_cast<int>(value);
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else if (argument == "--network" && i + 1 < argc) {
+            network_path = argv[++i];
+        } else if (argument == "--save" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    FPC::Network network;
+    if (network_path.empty()) {
+        network.randomize(seed);
+    } else if (!network.load(network_path)) {
+        std::cout << "Invalid network: " << network_path << '\n';
+        return 1;
+    }
+    if (!save_path.empty() && !network.save(save_path)) {
+        std::cout << "Cannot write to " << save_path << ".\n";
+        return 1;
+    }
+
+    const auto positions = random_positions(std::max<std::size_t>(position_count, 1), seed);
+    auto network_positions = positions;
+    for (auto& game : network_positions)
+        game.set_network(&network);
+    std::vector<FPC::MoveList> legal_moves(positions.size());
+    for (std::size_t i = 0; i < positions.size(); ++i)
+        positions[i].generate_legal_moves(positions[i].get_current_player(), legal_moves[i]);
+
+    // Summed up and printed, so that none of the work can be left out.
+    std::int64_t checksum = 0;
+    const auto network_evaluations = per_second(network_positions, rounds, [&](const FPC::GameState& game) { checksum += FPC::evaluate(game)[0]; });
+    const auto builtin_evaluations = per_second(positions, rounds, [&](const FPC::GameState& game) { checksum += FPC::evaluate(game)[0]; });
+    const auto refreshes = per_second(network_positions, rounds, [&](const FPC::GameState& game) { checksum += game.compute_accumulators()[0][0]; });
+    auto make_moves = [&](const std::vector<FPC::GameState>& games) {
+        std::size_t index = 0;
+        std::size_t move_count = 0;
+        const auto rate = per_second(games, rounds, [&](const FPC::GameState& game) {
+            auto child = game;
+            const auto& moves = legal_moves[index++ % games.size()];
+            for (const auto& move : moves)
+                child.unmake_move(child.make_move(move));
+            move_count += moves.size();
+            checksum += static_cast<std::int64_t>(child.get_hash() & 0xff);
+        });
+        return rate * static_cast<double>(move_count) / (static_cast<double>(games.size()) * rounds);
+    };
+    const auto network_moves = make_moves(network_positions);
+    const auto builtin_moves = make_moves(positions);
+
+    std::cout << "Kernels: " << FPC::Network::get_kernel_name() << '\n'
+              << "Positions: " << positions.size() << '\n'
+              << std::fixed << std::setprecision(0)
+              << "Evaluations per second (network): " << network_evaluations << '\n'
+              << "Evaluations per second (built-in): " << builtin_evaluations << '\n'
+              << "Accumulator refreshes per second: " << refreshes << '\n'
+              << "Moves made and taken back per second (network): " << network_moves << '\n'
+              << "Moves made and taken back per second (built-in): " << builtin_moves << '\n'
+              << "Checksum: " << checksum << '\n';
+    return 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace FPC {
+
+// A set of squares on the 14x14 board. Square (x, y) is bit 'x * 14 + y'; the 196 bits are spread over four 64-bit words.
+class Bitboard {
+public:
+    constexpr Bitboard() = default;
+
+    constexpr bool test(int index) const {
+        return (m_words[index / 64] >> (index % 64)) & 1;
+    }
+
+    constexpr void set(int index) {
+        m_words[index / 64] |= std::uint64_t(1) << (index % 64);
+    }
+
+    constexpr void reset(int index) {
+        m_words[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+    }
+
+    constexpr bool any() const {
+        return (m_words[0] | m_words[1] | m_words[2] | m_words[3]) != 0;
+    }
+
+    constexpr bool none() const {
+        return !any();
+    }
+
+    int count() const {
+        return __builtin_popcountll(m_words[0]) + __builtin_popcountll(m_words[1]) + __builtin_popcountll(m_words[2]) + __builtin_popcountll(m_words[3]);
+    }
+
+    // Both of these expect at least one bit to be set.
+    int lsb() const {
+        for (int i = 0; i < 4; ++i) {
+            if (m_words[i])
+                return i * 64 + __builtin_ctzll(m_words[i]);
+        }
+        __builtin_unreachable();
+    }
+
+    int msb() const {
+        for (int i = 3; i >= 0; --i) {
+            if (m_words[i])
+                return i * 64 + 63 - __builtin_clzll(m_words[i]);
+        }
+        __builtin_unreachable();
+    }
+
+    int pop_lsb() {
+        int index = lsb();
+        m_words[index / 64] &= m_words[index / 64] - 1;
+        return index;
+    }
+
+    // Calls 'callback' with the index of every set bit, in ascending order.
+    template<typename Callback>
+    void for_each(Callback callback) const {
+        for (int i = 0; i < 4; ++i) {
+            for (std::uint64_t word = m_words[i]; word; word &= word - 1)
+                callback(i * 64 + __builtin_ctzll(word));
+        }
+    }
+
+    constexpr Bitboard operator&(const Bitboard& rhs) const {
+        return {m_words[0] & rhs.m_words[0], m_words[1] & rhs.m_words[1], m_words[2] & rhs.m_words[2], m_words[3] & rhs.m_words[3]};
+    }
+
+    constexpr Bitboard operator|(const Bitboard& rhs) const {
+        return {m_words[0] | rhs.m_words[0], m_words[1] | rhs.m_words[1], m_words[2] | rhs.m_words[2], m_words[3] | rhs.m_words[3]};
+    }
+
+    constexpr Bitboard operator^(const Bitboard& rhs) const {
+        return {m_words[0] ^ rhs.m_words[0], m_words[1] ^ rhs.m_words[1], m_words[2] ^ rhs.m_words[2], m_words[3] ^ rhs.m_words[3]};
+    }
+
+    // Note that this also sets the 60 bits past the last square; mask the result with the playable squares where that matters.
+    constexpr Bitboard operator~() const {
+        return {~m_words[0], ~m_words[1], ~m_words[2], ~m_words[3]};
+    }
+
+    constexpr Bitboard& operator&=(const Bitboard& rhs) {
+        return *this = *this & rhs;
+    }
+
+    constexpr Bitboard& operator|=(const Bitboard& rhs) {
+        return *this = *this | rhs;
+    }
+
+    constexpr Bitboard& operator^=(const Bitboard& rhs) {
+        return *this = *this ^ rhs;
+    }
+
+    constexpr bool operator==(const Bitboard& rhs) const {
+        return m_words[0] == rhs.m_words[0] && m_words[1] == rhs.m_words[1] && m_words[2] == rhs.m_words[2] && m_words[3] == rhs.m_words[3];
+    }
+
+    constexpr bool operator!=(const Bitboard& rhs) const {
+        return !(*this == rhs);
+    }
+
+private:
+    constexpr Bitboard(std::uint64_t first, std::uint64_t second, std::uint64_t third, std::uint64_t fourth)
+        : m_words {first, second, third, fourth} {
+    }
+
+    std::array<std::uint64_t, 4> m_words {};
+};
+
+}
@@ -0,0 +1,68 @@
+#include "bots.h"
+
+namespace FPC {
+
+std::uint32_t RandomBot::random(std::uint32_t bound) {
+    m_random_state ^= m_random_state >> 12;
+    m_random_state ^= m_random_state << 25;
+    m_random_state ^= m_random_state >> 27;
+    return static_cast<std::uint32_t>(((m_random_state * 0x2545f4914f6cdd1d) >> 32) * bound >> 32);
+}
+
+Move RandomBot::choose_move(const GameState&, const MoveList& moves) {
+    return moves[random(moves.size())];
+}
+
+Move GreedyBot::choose_move(const GameState& game, const MoveList& moves) {
+    const auto player = static_cast<int>(game.get_current_player());
+    int best_score = -1;
+    std::uint32_t tied_moves = 0;
+    Move best_move = moves[0];
+    for (const auto& move : moves) {
+        // Turns cannot be taken back, and the turn must be passed on for checkmates and stalemates to eliminate anyone,
+        // so each move is played on its own copy.
+        auto child = game;
+        child.make_move(move);
+        child.advance_turn();
+        const int score = evaluate(child)[player];
+        // Reservoir sampling, so that every one of the best moves is as likely to be picked.
+        if (score > best_score) {
+            best_score = score;
+            best_move = move;
+            tied_moves = 1;
+        } else if (score == best_score && random(++tied_moves) == 0) {
+            best_move = move;
+        }
+    }
+    return best_move;
+}
+
+SearchBot::SearchBot(const SearchLimits& limits, std::size_t hash_size_in_megabytes)
+    : m_search(hash_size_in_megabytes)
+    , m_limits(limits) {
+}
+
+void SearchBot::new_game(std::uint64_t) {
+    m_search.get_transposition_table().clear();
+}
+
+Move SearchBot::choose_move(const GameState& game, const MoveList& moves) {
+    const auto result = m_search.run(game, m_limits);
+    for (const auto& move : moves) {
+        if (move == result.best_move)
+            return move;
+    }
+    return moves[0];
+}
+
+std::unique_ptr<Bot> make_bot(const std::string& name, const SearchLimits& search_limits, std::size_t hash_size_in_megabytes) {
+    if (name == "random")
+        return std::make_unique<RandomBot>();
+    if (name == "greedy")
+        return std::make_unique<GreedyBot>();
+    if (name == "search")
+        return std::make_unique<SearchBot>(search_limits, hash_size_in_megabytes);
+    return nullptr;
+}
+
+}
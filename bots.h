@@ -0,0 +1,65 @@
+#pragma once
+
+#include "library.h"
+#include "search.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace FPC {
+
+// A player that chooses its own moves. A bot may be used for any number of games one after another, but only by one thread
+// at a time.
+class Bot {
+public:
+    virtual ~Bot() = default;
+
+    // Called before every game, so that a game plays out the same whichever bot instance happens to play it.
+    virtual void new_game(std::uint64_t seed) = 0;
+    // 'moves' holds the legal moves of the player to move, of which there is at least one.
+    virtual Move choose_move(const GameState& game, const MoveList& moves) = 0;
+    virtual std::string get_name() const = 0;
+};
+
+// Plays any legal move.
+class RandomBot : public Bot {
+public:
+    void new_game(std::uint64_t seed) override { m_random_state = seed | 1; }
+    Move choose_move(const GameState& game, const MoveList& moves) override;
+    std::string get_name() const override { return "random"; }
+
+protected:
+    // xorshift64*, as good as a bot needs.
+    std::uint32_t random(std::uint32_t bound);
+
+private:
+    std::uint64_t m_random_state = 1;
+};
+
+// Plays the move that leaves it with the largest share of the evaluation, picking at random between equally good moves.
+class GreedyBot : public RandomBot {
+public:
+    Move choose_move(const GameState& game, const MoveList& moves) override;
+    std::string get_name() const override { return "greedy"; }
+};
+
+// Plays the best move found by a single-threaded 'Search' within the given limits, which should not include a time limit
+// if games are to be reproducible.
+class SearchBot : public Bot {
+public:
+    explicit SearchBot(const SearchLimits& limits, std::size_t hash_size_in_megabytes = 4);
+
+    void new_game(std::uint64_t seed) override;
+    Move choose_move(const GameState& game, const MoveList& moves) override;
+    std::string get_name() const override { return "search"; }
+
+private:
+    Search m_search;
+    SearchLimits m_limits;
+};
+
+// Makes the bot called 'name' ("random", "greedy" or "search"), or returns nullptr if there is no such bot.
+std::unique_ptr<Bot> make_bot(const std::string& name, const SearchLimits& search_limits, std::size_t hash_size_in_megabytes);
+
+}
@@ -1,2 +1,11 @@
 #!/usr/bin/env bash
-clang++ -std=c++17 -Wall -Wextra `sdl2-config --libs --cflags` -lSDL2_image main.cpp library.cpp GUI.cpp -o fpc
+clang++ -std=c++17 -Wall -Wextra `sdl2-config --libs --cflags` -lSDL2_image main.cpp library.cpp nnue.cpp GUI.cpp -o fpc
+clang++ -std=c++17 -O2 -Wall -Wextra -pthread library.cpp nnue.cpp thread_pool.cpp perft.cpp -o perft
+clang++ -std=c++17 -O2 -Wall -Wextra -pthread library.cpp nnue.cpp transposition_table.cpp search.cpp mcts.cpp analyze.cpp -o analyze
+clang++ -std=c++17 -O2 -Wall -Wextra library.cpp nnue.cpp game_database.cpp games.cpp -o games
+clang++ -std=c++17 -O2 -Wall -Wextra -pthread library.cpp nnue.cpp thread_pool.cpp transposition_table.cpp search.cpp game_database.cpp bots.cpp selfplay.cpp -o selfplay
+clang++ -std=c++17 -O2 -Wall -Wextra -pthread library.cpp nnue.cpp transposition_table.cpp search.cpp engine.cpp -o engine
+clang++ -std=c++17 -O2 -Wall -Wextra -pthread library.cpp nnue.cpp transposition_table.cpp search.cpp bench.cpp -o bench
+clang++ -std=c++17 -O2 -Wall -Wextra -mavx2 -pthread library.cpp nnue.cpp transposition_table.cpp search.cpp bench.cpp -o bench-avx2
+clang++ -std=c++17 -O2 -Wall -Wextra library.cpp nnue.cpp transposition_table.cpp game_database.cpp tests.cpp -o tests
+clang++ -std=c++17 -O2 -Wall -Wextra -mavx2 library.cpp nnue.cpp transposition_table.cpp game_database.cpp tests.cpp -o tests-avx2
@@ -0,0 +1,290 @@
+#include "library.h"
+#include "search.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A line-based protocol for driving any number of games at once. Every command but 'isready' and 'quit' names the game it
+// is about, and every reply starts with that name, as replies to 'go' come whenever the search gets to them.
+//
+//   position <game> (startpos | <position>) [moves <move>...]   Sets up a game, creating it if need be. Replies "<game> ok".
+//   moves <game> <move>...                                        Plays moves in a game. Replies "<game> ok", or
+//                                                                 "<game> error game over" once it is over.
+//   legal <game>                                                  Replies "<game> legal <move>...", without moves once it is over.
+//   show <game>                                                   Replies "<game> position <position>".
+//   go <game> [depth <plies>] [nodes <count>] [time <ms>] [maxn]  Searches the game in the background until a limit is reached,
+//                                                                 or until 'stop' if none is given. Replies "<game> info ..." after
+//                                                                 every iteration, then "<game> bestmove <move>" ("none" if over).
+//   stop <game>                                                   Makes the search of a game reply with its best move now.
+//   close <game>                                                  Stops and forgets a game.
+//   isready                                                       Replies "readyok" once every earlier command has been handled.
+//   quit                                                          Stops every search and exits.
+//
+// Positions and moves are written as in 'library.h'. A command which fails replies "<game> error <reason>" and changes nothing.
+// Setting up or playing moves in a game that is being searched stops the search first.
+
+static void print_usage() {
+    std::cout << "Usage: engine [--hash <megabytes>] [--threads <count>] [--network <file>]\n"
+              << "Reads commands from the standard input and writes the replies to the standard output; see engine.cpp for the protocol.\n"
+              << "Every game gets its own search, with a transposition table of --hash megabytes (16 by default) and --threads threads.\n"
+              << "With --network, every game is evaluated by the network in the given file rather than by the built-in terms.\n";
+}
+
+// Replies may come from any search thread, so every line is written whole and flushed at once.
+static void send(const std::string& line) {
+    static std::mutex mutex;
+    std::lock_guard lock(mutex);
+    std::fwrite(line.data(), 1, line.size(), stdout);
+    std::fputc('\n', stdout);
+    std::fflush(stdout);
+}
+
+struct Session {
+    FPC::GameState* game = nullptr; // Owned by the pool of 'main'.
+    std::unique_ptr<FPC::Search> search;
+    std::thread analysis;
+    std::atomic<bool> stop_requested {false};
+};
+
+static void stop_analysis(Session& session) {
+    if (!session.analysis.joinable())
+        return;
+    session.stop_requested.store(true, std::memory_order_relaxed);
+    session.search->stop();
+    session.analysis.join();
+}
+
+static std::vector<std::string_view> split(std::string_view line) {
+    std::vector<std::string_view> words;
+    while (!line.empty()) {
+        const auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos)
+            break;
+        const auto end = std::min(line.find_first_of(" \t\r", start), line.size());
+        words.push_back(line.substr(start, end - start));
+        line.remove_prefix(end);
+    }
+    return words;
+}
+
+// Plays every move, or none of them if one is illegal or comes after the end of the game, in which case it is returned.
+static std::optional<std::string_view> play_moves(FPC::GameState& game, const std::vector<std::string_view>& moves) {
+    auto played = game;
+    for (const auto& text : moves) {
+        const auto move = played.get_current_players().size() > 1 ? FPC::parse_move(played, text) : std::nullopt;
+        if (!move.has_value())
+            return text;
+        played.make_move(move.value());
+        played.advance_turn();
+    }
+    game = played;
+    return std::nullopt;
+}
+
+static std::string legal_moves_reply(const std::string& id, const FPC::GameState& game) {
+    std::string reply = id + " legal";
+    if (game.get_current_players().size() <= 1)
+        return reply;
+    FPC::MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    reply.reserve(reply.size() + moves.size() * 8);
+    for (const auto& move : moves) {
+        reply += ' ';
+        reply += FPC::move_to_string(move);
+    }
+    return reply;
+}
+
+static void start_analysis(const std::string& id, Session& session, const std::vector<std::string_view>& arguments, std::size_t hash_megabytes, int thread_count) {
+    FPC::SearchLimits limits;
+    bool max_n = false;
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (arguments[i] == "maxn") {
+            max_n = true;
+            continue;
+        }
+        std::uint64_t value = 0;
+        try {
+            if (i + 1 >= arguments.size())
+                throw std::invalid_argument("missing value");
+            value = std::stoull(std::string(arguments[i + 1]));
+        } catch (const std::exception&) {
+            send(id + " error invalid limit " + std::string(arguments[i]));
+            return;
+        }
+        if (arguments[i] == "depth") {
+            limits.depth = static_cast<int>(value);
+        } else if (arguments[i] == "nodes") {
+            limits.nodes = value;
+        } else if (arguments[i] == "time") {
+            limits.time = std::chrono::milliseconds(value);
+        } else {
+            send(id + " error invalid limit " + std::string(arguments[i]));
+            return;
+        }
+        ++i;
+    }
+
+    stop_analysis(session);
+    if (session.game->get_current_players().size() <= 1) {
+        send(id + " bestmove none");
+        return;
+    }
+    if (!session.search) {
+        session.search = std::make_unique<FPC::Search>(hash_megabytes);
+        session.search->set_thread_count(thread_count);
+    }
+    session.search->set_algorithm(max_n ? FPC::SearchAlgorithm::MaxN : FPC::SearchAlgorithm::Paranoid);
+    // A 'stop' that arrives before the search has started would be forgotten when it starts, so it is checked again after
+    // every iteration.
+    session.search->set_iteration_callback([id, &session](const FPC::SearchResult& result) {
+        std::string info = id + " info depth " + std::to_string(result.depth) + " score " + std::to_string(result.score) + " nodes "
+            + std::to_string(result.nodes) + " time " + std::to_string(result.time.count()) + " pv";
+        for (const auto& move : result.principal_variation)
+            info += ' ' + FPC::move_to_string(move);
+        send(info);
+        if (session.stop_requested.load(std::memory_order_relaxed))
+            session.search->stop();
+    });
+    session.stop_requested.store(false, std::memory_order_relaxed);
+    session.analysis = std::thread([id, &session, game = *session.game, limits] {
+        const auto result = session.search->run(game, limits);
+        send(id + " bestmove " + (result.best_move.is_null() ? "none" : FPC::move_to_string(result.best_move)));
+    });
+}
+
+int main(int argc, char** argv) {
+    std::size_t hash_megabytes = 16;
+    int thread_count = 1;
+    // Outlives every game, as these are all gone before 'main' returns.
+    FPC::Network network;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--network" && i + 1 < argc) {
+            if (!network.load(argv[++i])) {
+                std::cout << "Invalid network: " << argv[i] << '\n';
+                return 1;
+            }
+        } else if ((argument == "--hash" || argument == "--threads") && i + 1 < argc) {
+            try {
+                const auto value = std::stoull(argv[++i]);
+                if (argument == "--hash")
+                    hash_megabytes = value;
+                else
+                    thread_count = static_cast<int>(value);
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    // Sessions are never moved, as their searches keep pointing at them. Their positions come from a pool, so that
+    // hosting many games does not scatter them all over the heap.
+    FPC::GameStatePool pool;
+    std::unordered_map<std::string, std::unique_ptr<Session>> sessions;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        const auto words = split(line);
+        if (words.empty())
+            continue;
+        const auto command = words[0];
+        if (command == "quit")
+            break;
+        if (command == "isready") {
+            send("readyok");
+            continue;
+        }
+        if (words.size() < 2) {
+            send("error missing game in: " + line);
+            continue;
+        }
+
+        const std::string id(words[1]);
+        const std::vector<std::string_view> arguments(words.begin() + 2, words.end());
+        auto it = sessions.find(id);
+        if (command == "position") {
+            const auto moves = std::find(arguments.begin(), arguments.end(), "moves");
+            FPC::GameState game;
+            if (arguments.empty() || (arguments.front() == "startpos" ? moves != arguments.begin() + 1 : moves == arguments.begin())) {
+                send(id + " error invalid position");
+                continue;
+            }
+            if (arguments.front() != "startpos") {
+                // The fields were split apart along with everything else, and are joined back together.
+                const auto text = std::string_view(arguments.front().data(), (moves - 1)->data() + (moves - 1)->size() - arguments.front().data());
+                if (!FPC::parse_position(game, text)) {
+                    send(id + " error invalid position");
+                    continue;
+                }
+            }
+            if (moves != arguments.end()) {
+                if (const auto illegal = play_moves(game, std::vector<std::string_view>(moves + 1, arguments.end())); illegal.has_value()) {
+                    send(id + " error illegal move " + std::string(illegal.value()));
+                    continue;
+                }
+            }
+            if (network.is_loaded())
+                game.set_network(&network);
+            if (it == sessions.end()) {
+                it = sessions.emplace(id, std::make_unique<Session>()).first;
+                it->second->game = pool.acquire(game);
+            } else {
+                stop_analysis(*it->second);
+                *it->second->game = game;
+            }
+            send(id + " ok");
+            continue;
+        }
+
+        if (it == sessions.end()) {
+            send(id + " error unknown game");
+            continue;
+        }
+        auto& session = *it->second;
+        if (command == "moves") {
+            if (session.game->get_current_players().size() <= 1) {
+                send(id + " error game over");
+                continue;
+            }
+            auto game = *session.game;
+            if (const auto illegal = play_moves(game, arguments); illegal.has_value()) {
+                send(id + " error illegal move " + std::string(illegal.value()));
+                continue;
+            }
+            stop_analysis(session);
+            *session.game = game;
+            send(id + " ok");
+        } else if (command == "legal") {
+            send(legal_moves_reply(id, *session.game));
+        } else if (command == "show") {
+            send(id + " position " + FPC::position_to_string(*session.game));
+        } else if (command == "go") {
+            start_analysis(id, session, arguments, hash_megabytes, thread_count);
+        } else if (command == "stop") {
+            stop_analysis(session);
+        } else if (command == "close") {
+            stop_analysis(session);
+            pool.release(session.game);
+            sessions.erase(it);
+        } else {
+            send(id + " error unknown command " + std::string(command));
+        }
+    }
+
+    for (auto& [id, session] : sessions)
+        stop_analysis(*session);
+    return 0;
+}
@@ -0,0 +1,233 @@
+#include "game_database.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FPC {
+
+namespace {
+
+void write_little_endian(std::uint8_t* bytes, std::uint64_t value, int size) {
+    for (int i = 0; i < size; ++i)
+        bytes[i] = static_cast<std::uint8_t>(value >> (8 * i));
+}
+
+std::uint64_t read_little_endian(const std::uint8_t* bytes, int size) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < size; ++i)
+        value |= std::uint64_t(bytes[i]) << (8 * i);
+    return value;
+}
+
+// Returns the number of games and the offset of the index, or nothing if the header is not that of a game database.
+std::optional<std::pair<std::uint64_t, std::uint64_t>> read_header(const std::uint8_t* header) {
+    if (std::memcmp(header, GameDatabaseFormat::magic.data(), GameDatabaseFormat::magic.size()) != 0 || read_little_endian(header + 8, 4) != GameDatabaseFormat::version)
+        return std::nullopt;
+    return std::pair {read_little_endian(header + 16, 8), read_little_endian(header + 24, 8)};
+}
+
+}
+
+std::optional<Color> GameOutcome::get_winner() const {
+    if (eliminated.size() != 3)
+        return std::nullopt;
+    int remaining = 0xf;
+    for (const auto& player : eliminated)
+        remaining &= ~(1 << static_cast<int>(player));
+    return static_cast<Color>(__builtin_ctz(remaining));
+}
+
+// Players eliminated on the same turn are listed in the order of the 'Color' enum.
+void EliminationTracker::update(const GameState& game) {
+    for (auto it = m_remaining.begin(); it != m_remaining.end();) {
+        if (game.player_exists(*it)) {
+            ++it;
+            continue;
+        }
+        m_outcome.eliminated.push_back(*it);
+        it = m_remaining.erase(it);
+    }
+}
+
+GameDatabaseWriter::~GameDatabaseWriter() {
+    close();
+}
+
+bool GameDatabaseWriter::open(const std::string& path) {
+    close();
+    m_offsets.clear();
+    m_file = std::fopen(path.c_str(), "r+b");
+    const auto file_size = m_file && fseeko(m_file, 0, SEEK_END) == 0 ? ftello(m_file) : 0;
+    if (file_size > 0) {
+        std::array<std::uint8_t, GameDatabaseFormat::header_size> header {};
+        std::optional<std::pair<std::uint64_t, std::uint64_t>> contents;
+        if (fseeko(m_file, 0, SEEK_SET) == 0 && std::fread(header.data(), 1, header.size(), m_file) == header.size())
+            contents = read_header(header.data());
+        if (contents.has_value() && (contents->second > static_cast<std::uint64_t>(file_size) || contents->first > (file_size - contents->second) / 8))
+            contents.reset();
+        std::vector<std::uint8_t> index;
+        if (contents.has_value()) {
+            index.resize(contents->first * 8);
+            if (fseeko(m_file, static_cast<off_t>(contents->second), SEEK_SET) != 0 || std::fread(index.data(), 1, index.size(), m_file) != index.size())
+                contents.reset();
+        }
+        if (!contents.has_value()) {
+            std::fclose(m_file);
+            m_file = nullptr;
+            return false;
+        }
+        for (std::size_t i = 0; i < index.size(); i += 8)
+            m_offsets.push_back(read_little_endian(&index[i], 8));
+        fseeko(m_file, 0, SEEK_END);
+        m_end = static_cast<std::uint64_t>(file_size);
+    } else {
+        if (m_file)
+            std::fclose(m_file);
+        m_file = std::fopen(path.c_str(), "w+b");
+        if (!m_file)
+            return false;
+        // Left empty until 'close' writes the header.
+        const std::array<std::uint8_t, GameDatabaseFormat::header_size> header {};
+        if (std::fwrite(header.data(), 1, header.size(), m_file) != header.size()) {
+            std::fclose(m_file);
+            m_file = nullptr;
+            return false;
+        }
+        m_end = GameDatabaseFormat::header_size;
+    }
+    m_has_new_games = false;
+    return true;
+}
+
+bool GameDatabaseWriter::add_game(const std::vector<Move>& moves, const GameOutcome& outcome) {
+    if (!m_file || moves.size() > 0xffff || outcome.eliminated.size() > 3)
+        return false;
+
+    m_buffer.assign(GameDatabaseFormat::record_size, 0);
+    for (const auto& move : moves) {
+        if (move.promotion().has_value())
+            m_buffer.push_back(static_cast<std::uint8_t>(GameDatabaseFormat::promotion_marker + static_cast<int>(move.promotion().value())));
+        m_buffer.push_back(static_cast<std::uint8_t>(move.origin_index()));
+        m_buffer.push_back(static_cast<std::uint8_t>(move.destination_index()));
+    }
+    write_little_endian(&m_buffer[0], m_buffer.size() - GameDatabaseFormat::record_size, 4);
+    write_little_endian(&m_buffer[4], moves.size(), 2);
+    const auto winner = outcome.get_winner();
+    m_buffer[6] = winner.has_value() ? static_cast<std::uint8_t>(winner.value()) : GameDatabaseFormat::no_winner;
+    m_buffer[7] = static_cast<std::uint8_t>(outcome.eliminated.size());
+    for (std::size_t i = 0; i < outcome.eliminated.size(); ++i)
+        m_buffer[7] |= static_cast<int>(outcome.eliminated[i]) << (2 + 2 * i);
+
+    if (std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+        return false;
+    m_offsets.push_back(m_end);
+    m_end += m_buffer.size();
+    m_has_new_games = true;
+    return true;
+}
+
+bool GameDatabaseWriter::close() {
+    if (!m_file)
+        return true;
+    bool is_written = true;
+    // Reopening a database without adding anything leaves it untouched, rather than appending another copy of the index.
+    if (m_has_new_games || m_offsets.empty()) {
+        m_buffer.resize(m_offsets.size() * 8);
+        for (std::size_t i = 0; i < m_offsets.size(); ++i)
+            write_little_endian(&m_buffer[i * 8], m_offsets[i], 8);
+        is_written = std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) == m_buffer.size() && std::fflush(m_file) == 0;
+
+        // The header goes last, so that it never points at an index that is not complete.
+        std::array<std::uint8_t, GameDatabaseFormat::header_size> header {};
+        std::memcpy(header.data(), GameDatabaseFormat::magic.data(), GameDatabaseFormat::magic.size());
+        write_little_endian(&header[8], GameDatabaseFormat::version, 4);
+        write_little_endian(&header[16], m_offsets.size(), 8);
+        write_little_endian(&header[24], m_end, 8);
+        is_written = is_written && fseeko(m_file, 0, SEEK_SET) == 0 && std::fwrite(header.data(), 1, header.size(), m_file) == header.size();
+    }
+    is_written = std::fclose(m_file) == 0 && is_written;
+    m_file = nullptr;
+    return is_written;
+}
+
+std::optional<Color> GameView::get_winner() const {
+    if (m_record[6] > 3)
+        return std::nullopt;
+    return static_cast<Color>(m_record[6]);
+}
+
+bool GameFilter::matches(const GameView& game) const {
+    if (winner.has_value() && game.get_winner() != winner)
+        return false;
+    const int plies = game.get_ply_count();
+    if (plies < min_plies || (max_plies > 0 && plies > max_plies))
+        return false;
+    if (static_cast<int>(eliminated.size()) > game.get_eliminated_count())
+        return false;
+    for (std::size_t i = 0; i < eliminated.size(); ++i) {
+        if (game.get_eliminated(static_cast<int>(i)) != eliminated[i])
+            return false;
+    }
+    return true;
+}
+
+GameDatabase::~GameDatabase() {
+    close();
+}
+
+bool GameDatabase::open(const std::string& path) {
+    close();
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+    struct stat status {};
+    if (fstat(descriptor, &status) != 0 || status.st_size < static_cast<off_t>(GameDatabaseFormat::header_size)) {
+        ::close(descriptor);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+    if (data == MAP_FAILED)
+        return false;
+    m_data = static_cast<const std::uint8_t*>(data);
+    m_size = static_cast<std::size_t>(status.st_size);
+    // Scans go through the file from front to back, so the kernel might as well read ahead.
+    madvise(data, m_size, MADV_SEQUENTIAL);
+
+    // Every game is checked to start between the header and the index, so that looking at one never reads outside the file.
+    const auto contents = read_header(m_data);
+    bool is_valid = contents.has_value() && contents->second >= GameDatabaseFormat::header_size && contents->second <= m_size
+        && contents->first <= (m_size - contents->second) / 8;
+    for (std::uint64_t i = 0; is_valid && i < contents->first; ++i) {
+        const auto offset = read_little_endian(m_data + contents->second + 8 * i, 8);
+        is_valid = offset >= GameDatabaseFormat::header_size && offset + GameDatabaseFormat::record_size <= contents->second;
+    }
+    if (!is_valid) {
+        close();
+        return false;
+    }
+    m_game_count = contents->first;
+    m_index = m_data + contents->second;
+    return true;
+}
+
+void GameDatabase::close() {
+    if (m_data)
+        munmap(const_cast<std::uint8_t*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+    m_game_count = 0;
+    m_index = nullptr;
+}
+
+GameView GameDatabase::get_game(std::size_t index) const {
+    const auto* record = m_data + read_little_endian(m_index + 8 * index, 8);
+    const auto moves_size = read_little_endian(record, 4);
+    const auto space = static_cast<std::uint64_t>(m_index - record) - GameDatabaseFormat::record_size;
+    return {record, record + GameDatabaseFormat::record_size + std::min(moves_size, space)};
+}
+
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "library.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace FPC {
+
+// Game databases are binary files made of a header, the games one after another, and an index of where every game starts.
+// All numbers are little-endian.
+//
+// - The header holds the magic "FPCGAMES", the format version, the number of games and the offset of the index.
+// - Every game starts from the initial position and begins with an eight byte record: the size of its moves in bytes (32
+//   bits), the number of plies (16 bits), the winner ('no_winner' if the game was abandoned) and a byte holding how many
+//   players were eliminated in its lowest two bits, followed by those players in the order they were eliminated, two bits
+//   each. Then come the moves, two bytes each: the origin and destination square indices. A promotion is preceded by an
+//   extra byte, 'promotion_marker' plus the piece, which no square index reaches.
+// - The index is one 64-bit file offset per game.
+//
+// Games are only ever appended: a writer adds the new games after everything that is already there, then a new index, and
+// only then points the header at it. A writer that stops halfway leaves the file as it was, apart from some unused bytes.
+namespace GameDatabaseFormat {
+
+constexpr std::array<char, 8> magic {'F', 'P', 'C', 'G', 'A', 'M', 'E', 'S'};
+constexpr std::uint32_t version = 1;
+constexpr std::size_t header_size = 32;
+constexpr std::size_t record_size = 8;
+constexpr std::uint8_t no_winner = 0xff;
+constexpr std::uint8_t promotion_marker = 0xfc;
+
+}
+
+// What is stored about a game besides its moves.
+struct GameOutcome {
+    // The players in the order they were eliminated. Once three of them are gone, the fourth has won.
+    std::vector<Color> eliminated;
+
+    std::optional<Color> get_winner() const;
+};
+
+// Keeps track of the players eliminated over a game, to be told about every position after 'GameState::advance_turn'.
+class EliminationTracker {
+public:
+    void update(const GameState& game);
+    const GameOutcome& get_outcome() const { return m_outcome; }
+
+private:
+    std::vector<Color> m_remaining {Color::Red, Color::Blue, Color::Yellow, Color::Green};
+    GameOutcome m_outcome;
+};
+
+class GameDatabaseWriter {
+public:
+    GameDatabaseWriter() = default;
+    ~GameDatabaseWriter();
+
+    GameDatabaseWriter(const GameDatabaseWriter&) = delete;
+    GameDatabaseWriter& operator=(const GameDatabaseWriter&) = delete;
+
+    // Creates the file, or appends to it if it already is a game database. Returns false if it is something else or
+    // cannot be opened.
+    bool open(const std::string& path);
+    // The moves must have been played from the initial position.
+    bool add_game(const std::vector<Move>& moves, const GameOutcome& outcome);
+    // Writes the index and the header, without which the games added since opening are not part of the database.
+    bool close();
+    std::size_t get_game_count() const { return m_offsets.size(); }
+
+private:
+    std::FILE* m_file = nullptr;
+    std::uint64_t m_end = 0;
+    bool m_has_new_games = false;
+    std::vector<std::uint64_t> m_offsets;
+    std::vector<std::uint8_t> m_buffer;
+};
+
+// A game inside a mapped database. Only valid as long as the database stays open.
+class GameView {
+public:
+    int get_ply_count() const { return m_record[4] | m_record[5] << 8; }
+    std::optional<Color> get_winner() const;
+    int get_eliminated_count() const { return m_record[7] & 3; }
+    // The 'order'-th player to be eliminated, counting from zero.
+    Color get_eliminated(int order) const { return static_cast<Color>((m_record[7] >> (2 + 2 * order)) & 3); }
+
+    // Calls 'callback' with every move in turn, straight from the mapped file. Stops early if the callback returns false
+    // or the moves run past the end of the game, and returns whether it got through all of them.
+    template<typename Callback>
+    bool for_each_move(Callback callback) const;
+    // Plays the game on 'game', which is reset first, calling 'callback' with it after every ply. Returns false, leaving
+    // 'game' halfway, if the moves run past the end of the game or one of them does not move a piece of the player to move
+    // onto the board. They are not checked any further, which would take as long as generating every position's moves.
+    template<typename Callback>
+    bool replay(GameState& game, Callback callback) const;
+
+private:
+    friend class GameDatabase;
+
+    GameView(const std::uint8_t* record, const std::uint8_t* end)
+        : m_record(record)
+        , m_end(end) {
+    }
+
+    const std::uint8_t* m_record;
+    const std::uint8_t* m_end;
+};
+
+// Only the games which match every criterion that is set pass the filter.
+struct GameFilter {
+    std::optional<Color> winner;
+    int min_plies = 0;
+    int max_plies = 0; // Zero means no limit.
+    // The first players to be eliminated, in order.
+    std::vector<Color> eliminated;
+
+    bool matches(const GameView& game) const;
+};
+
+// Reads a game database by mapping it into memory, so that scanning it costs no more than touching its pages.
+class GameDatabase {
+public:
+    GameDatabase() = default;
+    ~GameDatabase();
+
+    GameDatabase(const GameDatabase&) = delete;
+    GameDatabase& operator=(const GameDatabase&) = delete;
+
+    // Returns false if the file cannot be mapped or is not a valid game database.
+    bool open(const std::string& path);
+    void close();
+    std::size_t get_game_count() const { return m_game_count; }
+    GameView get_game(std::size_t index) const;
+
+    template<typename Callback>
+    void for_each_game(const GameFilter& filter, Callback callback) const {
+        for (std::size_t i = 0; i < m_game_count; ++i) {
+            const auto game = get_game(i);
+            if (filter.matches(game))
+                callback(game);
+        }
+    }
+
+private:
+    const std::uint8_t* m_data = nullptr;
+    std::size_t m_size = 0;
+    std::size_t m_game_count = 0;
+    const std::uint8_t* m_index = nullptr;
+};
+
+template<typename Callback>
+bool GameView::for_each_move(Callback callback) const {
+    const std::uint8_t* bytes = m_record + GameDatabaseFormat::record_size;
+    for (int ply = get_ply_count(); ply > 0; --ply) {
+        std::optional<Piece> promotion;
+        if (bytes < m_end && bytes[0] >= GameDatabaseFormat::promotion_marker)
+            promotion = static_cast<Piece>(*bytes++ - GameDatabaseFormat::promotion_marker);
+        if (m_end - bytes < 2 || !callback(Move {bytes[0], bytes[1], 0, promotion}))
+            return false;
+        bytes += 2;
+    }
+    return true;
+}
+
+template<typename Callback>
+bool GameView::replay(GameState& game, Callback callback) const {
+    game.reset();
+    return for_each_move([&](const Move& move) {
+        if (move.origin_index() >= 196 || !game.point_is_of_color(move.origin(), game.get_current_player()) || !playable_squares().test(move.destination_index()))
+            return false;
+        game.make_move(move);
+        game.advance_turn();
+        callback(static_cast<const GameState&>(game));
+        return true;
+    });
+}
+
+}
@@ -0,0 +1,151 @@
+#include "game_database.h"
+#include "library.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+
+static void print_usage() {
+    std::cout << "Usage: games <file> [--generate <count>] [--seed <seed>] [--winner <color>] [--eliminated <color>...]\n"
+              << "             [--min-plies <plies>] [--max-plies <plies>] [--replay]\n"
+              << "Scans a game database and prints how many games match the filters, and how many games per second were scanned.\n"
+              << "Colors are written as 'r', 'b', 'y' and 'g', and --eliminated matches the first players to be eliminated, in order.\n"
+              << "With --replay, every matching game is also played through from the initial position.\n"
+              << "With --generate, that many random games are first added to the database, which is created if need be.\n";
+}
+
+static std::optional<FPC::Color> parse_color(char letter) {
+    constexpr std::string_view letters = "rbyg";
+    const auto color = letters.find(letter);
+    if (color == std::string_view::npos)
+        return std::nullopt;
+    return static_cast<FPC::Color>(color);
+}
+
+// Games which have not ended by then are abandoned, as nothing forces random players to finish.
+constexpr int s_random_game_ply_limit = 1000;
+
+static bool generate_random_games(const std::string& path, int count, std::uint64_t seed) {
+    FPC::GameDatabaseWriter writer;
+    if (!writer.open(path)) {
+        std::cout << "Cannot open " << path << " for writing.\n";
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::mt19937_64 random(seed);
+    FPC::GameState game;
+    FPC::MoveList moves;
+    std::vector<FPC::Move> played;
+    for (int i = 0; i < count; ++i) {
+        game.reset();
+        moves.clear();
+        game.generate_legal_moves(game.get_current_player(), moves);
+        played.clear();
+        FPC::EliminationTracker tracker;
+        while (game.get_current_players().size() > 1 && played.size() < s_random_game_ply_limit) {
+            const auto move = moves[random() % moves.size()];
+            game.make_move(move);
+            game.advance_turn(moves);
+            tracker.update(game);
+            played.push_back(move);
+        }
+        if (!writer.add_game(played, tracker.get_outcome())) {
+            std::cout << "Cannot write to " << path << ".\n";
+            return false;
+        }
+    }
+    if (!writer.close()) {
+        std::cout << "Cannot write to " << path << ".\n";
+        return false;
+    }
+
+    const auto milliseconds = std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), 1);
+    std::cout << "Generated " << count << " games in " << milliseconds << " ms (" << count * 1000 / milliseconds << " games per second)\n";
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    const std::string path = argv[1];
+    int generate_count = 0;
+    std::uint64_t seed = 0;
+    bool replay = false;
+    FPC::GameFilter filter;
+    for (int i = 2; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if ((argument == "--generate" || argument == "--seed" || argument == "--min-plies" || argument == "--max-plies") && i + 1 < argc) {
+            try {
+                const auto value = std::stoull(argv[++i]);
+                if (argument == "--generate")
+                    generate_count = static_cast<int>(value);
+                else if (argument == "--seed")
+                    seed = value;
+                else if (argument == "--min-plies")
+                    filter.min_plies = static_cast<int>(value);
+                else
+                    filter.max_plies = static_cast<int>(value);
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else if (argument == "--winner" && i + 1 < argc && std::string_view(argv[i + 1]).size() == 1 && parse_color(argv[i + 1][0]).has_value()) {
+            filter.winner = parse_color(argv[++i][0]);
+        } else if (argument == "--eliminated" && i + 1 < argc) {
+            for (const char letter : std::string_view(argv[++i])) {
+                const auto color = parse_color(letter);
+                if (!color.has_value()) {
+                    print_usage();
+                    return 1;
+                }
+                filter.eliminated.push_back(color.value());
+            }
+        } else if (argument == "--replay") {
+            replay = true;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (generate_count > 0 && !generate_random_games(path, generate_count, seed))
+        return 1;
+
+    FPC::GameDatabase database;
+    if (!database.open(path)) {
+        std::cout << "Cannot read " << path << " as a game database.\n";
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::uint64_t matches = 0;
+    std::uint64_t plies = 0;
+    std::uint64_t invalid_games = 0;
+    FPC::GameState game;
+    database.for_each_game(filter, [&](const FPC::GameView& view) {
+        ++matches;
+        if (!replay) {
+            plies += view.get_ply_count();
+            return;
+        }
+        if (!view.replay(game, [&](const FPC::GameState&) { ++plies; }))
+            ++invalid_games;
+    });
+    const auto microseconds = std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(), 1);
+
+    std::cout << "Games: " << database.get_game_count() << '\n'
+              << "Matching: " << matches << " (" << plies << " plies)\n"
+              << "Time: " << microseconds / 1000 << " ms\n"
+              << "Games per second: " << database.get_game_count() * 1000000 / microseconds << '\n';
+    if (replay) {
+        std::cout << "Plies per second: " << plies * 1000000 / microseconds << '\n';
+        if (invalid_games > 0)
+            std::cout << "Games that could not be replayed: " << invalid_games << '\n';
+    }
+    return 0;
+}
@@ -1,115 +1,1203 @@
 #include "library.h"
 #include <algorithm>
 #include <cmath>
+#include <exception>
 #include <iostream>
+#include <new>
+#include <type_traits>
 
 namespace FPC {
 
+namespace {
+
+// Sliding directions; the first four are orthogonal, the last four diagonal.
+constexpr std::array<Point, 8> s_directions {Point {1, 0}, Point {-1, 0}, Point {0, 1}, Point {0, -1}, Point {1, 1}, Point {-1, -1}, Point {-1, 1}, Point {1, -1}};
+
+// Whether walking in the given direction increases the square index, which decides how the nearest piece on a ray is found.
+constexpr bool direction_is_ascending(const Point& direction) {
+    return direction.x * 14 + direction.y > 0;
+}
+
+// Must be accessed in the same order as the 'Color' enum.
+constexpr std::array<Point, 4> s_pawn_directions {Point {0, -1}, Point {1, 0}, Point {0, 1}, Point {-1, 0}};
+
+struct CastlingOption {
+    Point king_destination;
+    Point rook_origin;
+    Point rook_destination;
+};
+
+// Must be accessed in the same order as the 'Color' enum.
+constexpr std::array<Point, 4> s_initial_king_positions {Point {7, 13}, Point {0, 6}, Point {6, 0}, Point {13, 7}};
+constexpr std::array<std::array<CastlingOption, 2>, 4> s_castling_options {{
+    {CastlingOption {{5, 13}, {3, 13}, {6, 13}}, CastlingOption {{9, 13}, {10, 13}, {8, 13}}},
+    {CastlingOption {{0, 4}, {0, 3}, {0, 5}}, CastlingOption {{0, 8}, {0, 10}, {0, 7}}},
+    {CastlingOption {{4, 0}, {3, 0}, {5, 0}}, CastlingOption {{8, 0}, {10, 0}, {7, 0}}},
+    {CastlingOption {{13, 5}, {13, 3}, {13, 6}}, CastlingOption {{13, 9}, {13, 10}, {13, 8}}},
+}};
+
+// Marks the end of a square list, and the squares off the board in the padded mailbox.
+constexpr std::uint8_t s_no_square = 0xff;
+
+constexpr bool is_playable(int x, int y) {
+    if (x < 0 || y < 0 || x > 13 || y > 13)
+        return false;
+    // The four cut-out corners.
+    return !((x < 3 || x > 10) && (y < 3 || y > 10));
+}
+
+// The board surrounded by two files and ranks of off-board squares, in the manner of a 0x88 board: any king, knight or pawn
+// step from a playable square lands inside the array, so stepping around needs no bounds checks, only a sentinel test.
+// Holds the square index of every playable square and 's_no_square' everywhere else, the corners included.
+constexpr int s_mailbox_margin = 2;
+constexpr int s_mailbox_width = 14 + 2 * s_mailbox_margin;
+
+constexpr std::array<std::uint8_t, s_mailbox_width * s_mailbox_width> build_mailbox() {
+    std::array<std::uint8_t, s_mailbox_width * s_mailbox_width> mailbox {};
+    for (int x = -s_mailbox_margin; x < 14 + s_mailbox_margin; ++x) {
+        for (int y = -s_mailbox_margin; y < 14 + s_mailbox_margin; ++y)
+            mailbox[(x + s_mailbox_margin) * s_mailbox_width + y + s_mailbox_margin] = is_playable(x, y) ? static_cast<std::uint8_t>(x * 14 + y) : s_no_square;
+    }
+    return mailbox;
+}
+
+constexpr auto s_mailbox = build_mailbox();
+
+constexpr int mailbox_index(int index) {
+    return (index / 14 + s_mailbox_margin) * s_mailbox_width + index % 14 + s_mailbox_margin;
+}
+
+constexpr int mailbox_offset(const Point& step) {
+    return step.x * s_mailbox_width + step.y;
+}
+
+constexpr std::array<Point, 8> s_knight_offsets {Point {-2, -1}, Point {-1, -2}, Point {1, -2}, Point {2, -1}, Point {-2, 1}, Point {-1, 2}, Point {1, 2}, Point {2, 1}};
+
+// Up to 'N' square indices followed by 's_no_square', so that a loop over them needs neither a count nor a bounds check.
+template<std::size_t N>
+using SquareList = std::array<std::uint8_t, N + 1>;
+
+struct SquareLists {
+    std::array<SquareList<8>, 196> knight_targets;
+    std::array<SquareList<8>, 196> king_targets;
+    // The squares in each direction, nearest first, up to the edge of the board or a corner.
+    std::array<std::array<SquareList<13>, 196>, 8> rays;
+    // The square in front of a pawn of the given color, or 's_no_square' at the edge of the board.
+    std::array<std::array<std::uint8_t, 196>, 4> pawn_pushes;
+};
+
+// Squares off the board get empty lists.
+constexpr SquareLists build_square_lists() {
+    SquareLists lists {};
+    for (int index = 0; index < 196; ++index) {
+        const int origin = mailbox_index(index);
+        const bool is_on_board = s_mailbox[origin] != s_no_square;
+
+        int knight_count = 0;
+        for (const auto& offset : s_knight_offsets) {
+            const auto target = s_mailbox[origin + mailbox_offset(offset)];
+            if (is_on_board && target != s_no_square)
+                lists.knight_targets[index][knight_count++] = target;
+        }
+        lists.knight_targets[index][knight_count] = s_no_square;
+
+        int king_count = 0;
+        for (int direction = 0; direction < 8; ++direction) {
+            auto& ray = lists.rays[direction][index];
+            const int step = mailbox_offset(s_directions[direction]);
+            int length = 0;
+            for (int current = origin + step; is_on_board && s_mailbox[current] != s_no_square; current += step)
+                ray[length++] = s_mailbox[current];
+            ray[length] = s_no_square;
+            if (length > 0)
+                lists.king_targets[index][king_count++] = ray[0];
+        }
+        lists.king_targets[index][king_count] = s_no_square;
+
+        for (int color = 0; color < 4; ++color)
+            lists.pawn_pushes[color][index] = is_on_board ? s_mailbox[origin + mailbox_offset(s_pawn_directions[color])] : s_no_square;
+    }
+    return lists;
+}
+
+constexpr SquareLists s_square_lists = build_square_lists();
+
+struct BoardTables {
+    Bitboard playable;
+    std::array<Bitboard, 196> knight_attacks;
+    std::array<Bitboard, 196> king_attacks;
+    std::array<std::array<Bitboard, 196>, 4> pawn_attacks;
+    // The squares a pawn of a given color would have to stand on to attack the indexed square.
+    std::array<std::array<Bitboard, 196>, 4> pawn_attackers;
+    std::array<std::array<Bitboard, 196>, 8> rays;
+};
+
+constexpr Bitboard to_bitboard(const std::uint8_t* squares) {
+    Bitboard bitboard {};
+    for (; *squares != s_no_square; ++squares)
+        bitboard.set(*squares);
+    return bitboard;
+}
+
+constexpr BoardTables build_board_tables() {
+    BoardTables tables {};
+    for (int index = 0; index < 196; ++index) {
+        const int origin = mailbox_index(index);
+        if (s_mailbox[origin] == s_no_square)
+            continue;
+        tables.playable.set(index);
+        tables.knight_attacks[index] = to_bitboard(s_square_lists.knight_targets[index].data());
+        tables.king_attacks[index] = to_bitboard(s_square_lists.king_targets[index].data());
+        for (int direction = 0; direction < 8; ++direction)
+            tables.rays[direction][index] = to_bitboard(s_square_lists.rays[direction][index].data());
+
+        for (int color = 0; color < 4; ++color) {
+            const auto& direction = s_pawn_directions[color];
+            const Point side {direction.y, direction.x};
+            for (const int sign : {1, -1}) {
+                const auto attacked = s_mailbox[origin + mailbox_offset({direction.x + sign * side.x, direction.y + sign * side.y})];
+                if (attacked != s_no_square)
+                    tables.pawn_attacks[color][index].set(attacked);
+                const auto attacker = s_mailbox[origin + mailbox_offset({sign * side.x - direction.x, sign * side.y - direction.y})];
+                if (attacker != s_no_square)
+                    tables.pawn_attackers[color][index].set(attacker);
+            }
+        }
+    }
+    return tables;
+}
+
+constexpr BoardTables s_board_tables = build_board_tables();
+
+// Piece values used by 'GameState::static_exchange', in the order of the 'Piece' enum. The king outweighs everything else
+// together, so that it never takes part in an exchange it would not survive.
+constexpr std::array<int, 6> s_exchange_values {900, 500, 450, 300, 10000, 100};
+
+// Piece values used by 'Evaluator', in the order of the 'Piece' enum. The king has none, as it never leaves the board
+// without its player.
+constexpr std::array<int, 6> s_material_values {900, 500, 450, 300, 0, 100};
+// What each pawn next to its king adds to the king's safety.
+constexpr int s_shelter_value = 15;
+
+// The file and rank of a square as seen by a player, with ranks counted from their back rank and files from their left.
+// Every player's king thus starts on file 7 and their queen on file 6.
+constexpr std::pair<int, int> relative_square(int color, int index) {
+    const int x = index / 14;
+    const int y = index % 14;
+    switch (color) {
+        case 0:
+            return {x, 13 - y};
+        case 1:
+            return {13 - y, x};
+        case 2:
+            return {13 - x, y};
+        default:
+            return {y, 13 - x};
+    }
+}
+
+// What a piece is worth on a square on top of its material, as seen from its player's side of the board. Minor pieces
+// belong in the centre, pawns gain as they advance and the king is best left at home.
+constexpr int piece_square_value(Piece piece, int file, int rank) {
+    const int file_distance = file < 7 ? 6 - file : file - 7;
+    const int rank_distance = rank < 7 ? 6 - rank : rank - 7;
+    const int centrality = 12 - file_distance - rank_distance;
+    switch (piece) {
+        case Piece::Pawn:
+            return 3 * (rank - 1) + (file_distance < 2 ? 5 : 0);
+        case Piece::Knight:
+            return 4 * centrality - 20;
+        case Piece::Bishop:
+            return 2 * centrality - 10;
+        case Piece::Rook:
+        case Piece::Queen:
+            return centrality - 6;
+        case Piece::King:
+            return -12 * rank;
+    }
+    return 0;
+}
+
+// Indexed by color, piece and square index, so that each player's table is already turned towards their side of the board.
+struct PieceSquareTables {
+    std::array<std::array<std::array<std::int16_t, 196>, 6>, 4> values {};
+};
+
+constexpr PieceSquareTables build_piece_square_tables() {
+    PieceSquareTables tables {};
+    for (int color = 0; color < 4; ++color) {
+        for (int piece = 0; piece < 6; ++piece) {
+            for (int index = 0; index < 196; ++index) {
+                const auto [file, rank] = relative_square(color, index);
+                tables.values[color][piece][index] = static_cast<std::int16_t>(piece_square_value(static_cast<Piece>(piece), file, rank));
+            }
+        }
+    }
+    return tables;
+}
+
+constexpr PieceSquareTables s_piece_square_tables = build_piece_square_tables();
+
+// The index of every square among the playable ones as seen by each color, counted file by file from the color's left
+// and rank by rank from their back rank, for the features of 'Network'. Indexed by color and square index.
+constexpr std::array<std::array<std::uint8_t, 196>, 4> build_network_squares() {
+    std::array<std::array<std::uint8_t, 196>, 4> squares {};
+    for (int color = 0; color < 4; ++color) {
+        for (int index = 0; index < 196; ++index) {
+            const auto [file, rank] = relative_square(color, index);
+            int playable = 0;
+            for (int before = 0; before < file * 14 + rank; ++before)
+                playable += is_playable(before / 14, before % 14);
+            squares[color][index] = static_cast<std::uint8_t>(playable);
+        }
+    }
+    return squares;
+}
+
+constexpr auto s_network_squares = build_network_squares();
+
+constexpr int direction_index(const Point& direction) {
+    for (int i = 0; i < 8; ++i) {
+        if (s_directions[i] == direction)
+            return i;
+    }
+    return -1;
+}
+
+// Everything about a player's pawns and castling that depends on the side of the board they start on. Move generation is
+// instantiated once per color with these, so that none of it has to be looked up or switched on while generating moves.
+template<Color C>
+struct ColorTraits {
+    static constexpr Color color = C;
+    static constexpr int index = static_cast<int>(C);
+    static constexpr Point pawn_direction = s_pawn_directions[index];
+    // Pawns capture diagonally forwards, so the sideways part of a capture is along this axis.
+    static constexpr Axis capture_axis = pawn_direction.x == 0 ? Axis::X : Axis::Y;
+    static constexpr Point capture_side {capture_axis == Axis::X, capture_axis == Axis::Y};
+    // Ranks are counted along the direction the pawns move in: pawns double jump from 'pawn_rank', land on
+    // 'double_jump_rank' when they do and promote on 'promotion_rank'.
+    static constexpr int pawn_rank = pawn_direction.x + pawn_direction.y > 0 ? 1 : 12;
+    static constexpr int double_jump_rank = pawn_rank + 2 * (pawn_direction.x + pawn_direction.y);
+    static constexpr int promotion_rank = pawn_direction.x + pawn_direction.y > 0 ? 13 : 0;
+    // Indices into 's_directions' of each diagonal capture step, paired with the sideways step to the pawn that it takes en passant.
+    static constexpr std::array<std::pair<int, int>, 2> captures {{
+        {direction_index({pawn_direction.x + capture_side.x, pawn_direction.y + capture_side.y}), direction_index(capture_side)},
+        {direction_index({pawn_direction.x - capture_side.x, pawn_direction.y - capture_side.y}), direction_index({-capture_side.x, -capture_side.y})},
+    }};
+    static constexpr Point king_origin = s_initial_king_positions[index];
+    static constexpr const std::array<CastlingOption, 2>& castling_options = s_castling_options[index];
+
+    static constexpr int rank_of(const Point& position) {
+        return capture_axis == Axis::X ? position.y : position.x;
+    }
+
+    static constexpr int rank_of(int index) {
+        return capture_axis == Axis::X ? index % 14 : index / 14;
+    }
+};
+
+// Calls 'function' with the 'ColorTraits' of the given color.
+template<typename Function>
+decltype(auto) with_color_traits(Color color, Function&& function) {
+    switch (color) {
+        case Color::Red:
+            return function(ColorTraits<Color::Red> {});
+        case Color::Blue:
+            return function(ColorTraits<Color::Blue> {});
+        case Color::Yellow:
+            return function(ColorTraits<Color::Yellow> {});
+        case Color::Green:
+            return function(ColorTraits<Color::Green> {});
+        default:
+            __builtin_unreachable();
+    }
+}
+
+struct ZobristKeys {
+    std::array<std::array<std::array<std::uint64_t, 196>, 4>, 6> pieces;
+    std::array<std::uint64_t, 4> side_to_move;
+    // Indexed by the full castling rights mask, so that a change of rights is a single XOR.
+    std::array<std::uint64_t, 256> castling;
+    std::array<std::uint64_t, 196> en_passant;
+    std::array<std::uint64_t, 4> eliminated;
+    // The squares whose contents decide the castling rights.
+    Bitboard castling_squares;
+};
+
+ZobristKeys build_zobrist_keys() {
+    ZobristKeys keys {};
+    // SplitMix64 with a fixed seed, so hashes are stable across runs and builds.
+    std::uint64_t state = 0x4650432d5a4f4252;
+    auto next = [&state]() {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    };
+
+    for (auto& piece : keys.pieces) {
+        for (auto& color : piece) {
+            for (auto& key : color)
+                key = next();
+        }
+    }
+    for (auto& key : keys.side_to_move)
+        key = next();
+    std::array<std::uint64_t, 8> rights {};
+    for (auto& key : rights)
+        key = next();
+    for (int mask = 0; mask < 256; ++mask) {
+        for (int right = 0; right < 8; ++right) {
+            if (mask & (1 << right))
+                keys.castling[mask] ^= rights[right];
+        }
+    }
+    for (auto& key : keys.en_passant)
+        key = next();
+    for (auto& key : keys.eliminated)
+        key = next();
+
+    for (int color = 0; color < 4; ++color) {
+        keys.castling_squares.set(square_index(s_initial_king_positions[color]));
+        for (const auto& option : s_castling_options[color])
+            keys.castling_squares.set(square_index(option.rook_origin));
+    }
+    return keys;
+}
+
+const ZobristKeys s_zobrist_keys = build_zobrist_keys();
+
+}
+
 bool is_valid_position(const FPC::Point& position) {
-    if (position.x < 0 || position.y < 0 || position.x > 13 || position.y > 13)
+    return is_playable(position.x, position.y);
+}
+
+bool is_promotion_square(const Point& position, Color player) {
+    return with_color_traits(player, [&](auto traits) { return decltype(traits)::rank_of(position) == decltype(traits)::promotion_rank; });
+}
+
+std::string move_to_string(const Move& move) {
+    std::string text;
+    for (const auto& square : {move.origin(), move.destination()}) {
+        text.push_back(static_cast<char>('a' + square.x));
+        text.append(std::to_string(14 - square.y));
+    }
+    if (move.promotion().has_value())
+        text.push_back("qrbn"[static_cast<int>(move.promotion().value())]);
+    return text;
+}
+
+// Only accepts moves which are legal for the player whose turn it is.
+std::optional<Move> parse_move(const GameState& game, std::string_view text) {
+    MoveList legal_moves;
+    game.generate_legal_moves(game.get_current_player(), legal_moves);
+    for (const auto& move : legal_moves) {
+        if (move_to_string(move) == text)
+            return move;
+    }
+    return std::nullopt;
+}
+
+const Bitboard& playable_squares() {
+    return s_board_tables.playable;
+}
+
+namespace {
+
+constexpr std::string_view s_color_letters = "rbyg";
+constexpr std::string_view s_piece_letters = "QRBNKP";
+
+// The rook on the king's side starts three squares away from the king, the one on the queen's side four.
+constexpr bool is_kingside_castling(int color, int option) {
+    const auto& king = s_initial_king_positions[color];
+    const auto& rook = s_castling_options[color][option].rook_origin;
+    return std::abs(king.x - rook.x) + std::abs(king.y - rook.y) == 3;
+}
+
+// Which castling option, as a bit of 'GameState::castling_rights', uses the rook starting on the given square, if any.
+constexpr int castling_right_of_rook(int color, int index) {
+    for (int option = 0; option < 2; ++option) {
+        if (square_index(s_castling_options[color][option].rook_origin) == index)
+            return 1 << (2 * color + option);
+    }
+    return 0;
+}
+
+// Packs values of a few bits each into bytes, least significant bit first.
+class BitWriter {
+public:
+    explicit BitWriter(std::uint8_t* bytes)
+        : m_bytes(bytes) {
+    }
+
+    void write(std::uint32_t value, int bit_count) {
+        m_buffer |= std::uint64_t(value) << m_bit_count;
+        for (m_bit_count += bit_count; m_bit_count >= 8; m_bit_count -= 8, m_buffer >>= 8)
+            *m_bytes++ = static_cast<std::uint8_t>(m_buffer);
+    }
+
+    void flush() {
+        if (m_bit_count > 0)
+            *m_bytes++ = static_cast<std::uint8_t>(m_buffer);
+        m_buffer = 0;
+        m_bit_count = 0;
+    }
+
+private:
+    std::uint8_t* m_bytes;
+    std::uint64_t m_buffer = 0;
+    int m_bit_count = 0;
+};
+
+class BitReader {
+public:
+    explicit BitReader(const std::uint8_t* bytes)
+        : m_bytes(bytes) {
+    }
+
+    std::uint32_t read(int bit_count) {
+        for (; m_bit_count < bit_count; m_bit_count += 8)
+            m_buffer |= std::uint64_t(*m_bytes++) << m_bit_count;
+        const auto value = static_cast<std::uint32_t>(m_buffer & ((std::uint64_t(1) << bit_count) - 1));
+        m_buffer >>= bit_count;
+        m_bit_count -= bit_count;
+        return value;
+    }
+
+private:
+    const std::uint8_t* m_bytes;
+    std::uint64_t m_buffer = 0;
+    int m_bit_count = 0;
+};
+
+// Codes of the packed form: 'color * 6 + piece' for most pieces, then the pawns which may be taken en passant and the
+// rooks which may still castle, one of each per color.
+constexpr std::uint32_t s_en_passant_pawn_code = 24;
+constexpr std::uint32_t s_castling_rook_code = 28;
+
+}
+
+std::size_t write_position(const GameState& game, char* buffer) {
+    char* out = buffer;
+    auto write_number = [&](int number) {
+        if (number >= 10)
+            *out++ = static_cast<char>('0' + number / 10);
+        *out++ = static_cast<char>('0' + number % 10);
+    };
+
+    const auto& board = game.get_board();
+    for (int y = 0; y < 14; ++y) {
+        if (y > 0)
+            *out++ = '/';
+        int empty_squares = 0;
+        for (int x = 0; x < 14; ++x) {
+            const auto& square = board[x][y];
+            if (!square.piece().has_value()) {
+                ++empty_squares;
+                continue;
+            }
+            if (empty_squares > 0)
+                write_number(empty_squares);
+            empty_squares = 0;
+            *out++ = s_color_letters[static_cast<int>(square.color().value())];
+            *out++ = s_piece_letters[static_cast<int>(square.piece().value())];
+        }
+        if (empty_squares > 0)
+            write_number(empty_squares);
+    }
+
+    *out++ = ' ';
+    *out++ = s_color_letters[static_cast<int>(game.get_current_player())];
+    *out++ = ' ';
+    for (const auto& player : game.get_current_players())
+        *out++ = s_color_letters[static_cast<int>(player)];
+
+    *out++ = ' ';
+    const int rights = game.castling_rights();
+    if (rights == 0)
+        *out++ = '-';
+    for (int color = 0; color < 4; ++color) {
+        if (!(rights & (3 << (2 * color))))
+            continue;
+        *out++ = s_color_letters[color];
+        for (const bool kingside : {true, false}) {
+            for (int option = 0; option < 2; ++option) {
+                if (is_kingside_castling(color, option) == kingside && (rights & (1 << (2 * color + option))))
+                    *out++ = kingside ? 'K' : 'Q';
+            }
+        }
+    }
+
+    *out++ = ' ';
+    const char* en_passant = out;
+    playable_squares().for_each([&](int index) {
+        if (!board[index / 14][index % 14].just_double_jumped())
+            return;
+        if (out != en_passant)
+            *out++ = ',';
+        *out++ = static_cast<char>('a' + index / 14);
+        write_number(14 - index % 14);
+    });
+    if (out == en_passant)
+        *out++ = '-';
+    return out - buffer;
+}
+
+std::string position_to_string(const GameState& game) {
+    std::string text(max_position_length, '\0');
+    text.resize(write_position(game, text.data()));
+    return text;
+}
+
+bool parse_position(GameState& game, std::string_view text) {
+    std::array<std::array<Square, 14>, 14> board {};
+    std::size_t i = 0;
+    auto is_digit = [&]() {
+        return i < text.size() && text[i] >= '0' && text[i] <= '9';
+    };
+    // Accepts 1 to 14.
+    auto parse_number = [&](int& number) {
+        if (!is_digit())
+            return false;
+        for (number = 0; is_digit() && number <= 14;)
+            number = number * 10 + text[i++] - '0';
+        return number >= 1 && number <= 14;
+    };
+    auto parse_color = [&](int& color) {
+        if (i >= text.size() || s_color_letters.find(text[i]) == std::string_view::npos)
+            return false;
+        color = static_cast<int>(s_color_letters.find(text[i++]));
+        return true;
+    };
+    auto expect = [&](char character) {
+        if (i >= text.size() || text[i] != character)
+            return false;
+        ++i;
+        return true;
+    };
+
+    for (int y = 0; y < 14; ++y) {
+        if (y > 0 && !expect('/'))
+            return false;
+        for (int x = 0; x < 14;) {
+            if (is_digit()) {
+                int empty_squares = 0;
+                if (!parse_number(empty_squares) || x + empty_squares > 14)
+                    return false;
+                x += empty_squares;
+                continue;
+            }
+            int color = 0;
+            if (!parse_color(color) || i >= text.size() || s_piece_letters.find(text[i]) == std::string_view::npos)
+                return false;
+            board[x][y].set_color(static_cast<Color>(color));
+            board[x][y].set_piece(static_cast<Piece>(s_piece_letters.find(text[i++])));
+            ++x;
+        }
+    }
+
+    int player = 0;
+    if (!expect(' ') || !parse_color(player) || !expect(' '))
         return false;
-    if ((position.x < 3 && position.y < 3)
-        || (position.x > 10 && position.y > 10)
-        || (position.x < 3 && position.y > 10)
-        || (position.x > 10 && position.y < 3))
+    int remaining_players = 0;
+    for (int color = 0; parse_color(color);) {
+        if (remaining_players & (1 << color))
+            return false;
+        remaining_players |= 1 << color;
+    }
+
+    int castling_rights = 0;
+    if (!expect(' '))
         return false;
-    return true;
+    if (!expect('-')) {
+        for (int color = 0; parse_color(color);) {
+            int rights = 0;
+            for (; i < text.size() && (text[i] == 'K' || text[i] == 'Q'); ++i) {
+                for (int option = 0; option < 2; ++option) {
+                    if (is_kingside_castling(color, option) == (text[i] == 'K'))
+                        rights |= 1 << (2 * color + option);
+                }
+            }
+            if (rights == 0)
+                return false;
+            castling_rights |= rights;
+        }
+        if (castling_rights == 0)
+            return false;
+    }
+
+    if (!expect(' '))
+        return false;
+    if (!expect('-')) {
+        do {
+            int file = 0;
+            int rank = 0;
+            if (i >= text.size() || text[i] < 'a' || text[i] > 'n')
+                return false;
+            file = text[i++] - 'a';
+            if (!parse_number(rank))
+                return false;
+            board[file][14 - rank].set_just_double_jumped(true);
+        } while (expect(','));
+    }
+    if (i != text.size())
+        return false;
+    return game.set_position(board, static_cast<Color>(player), remaining_players, castling_rights);
+}
+
+PackedPosition pack_position(const GameState& game) {
+    PackedPosition packed {};
+    packed[0] = static_cast<std::uint8_t>(static_cast<int>(game.get_current_player()) | game.get_current_players().mask() << 2);
+
+    BitWriter writer(&packed[1]);
+    const auto& occupied = game.get_occupied_squares();
+    playable_squares().for_each([&](int index) {
+        writer.write(occupied.test(index), 1);
+    });
+
+    const auto& board = game.get_board();
+    const int rights = game.castling_rights();
+    occupied.for_each([&](int index) {
+        const auto& square = board[index / 14][index % 14];
+        const int color = static_cast<int>(square.color().value());
+        if (square.just_double_jumped())
+            writer.write(s_en_passant_pawn_code + color, 5);
+        else if (square.piece() == Piece::Rook && (rights & castling_right_of_rook(color, index)))
+            writer.write(s_castling_rook_code + color, 5);
+        else
+            writer.write(color * 6 + static_cast<int>(square.piece().value()), 5);
+    });
+    writer.flush();
+    return packed;
+}
+
+bool unpack_position(GameState& game, const PackedPosition& packed) {
+    if (packed[0] >> 6)
+        return false;
+    BitReader reader(&packed[1]);
+    Bitboard occupied {};
+    playable_squares().for_each([&](int index) {
+        if (reader.read(1))
+            occupied.set(index);
+    });
+    // Sixty-four pieces take up the 61 bytes; any more could not have been packed.
+    if (occupied.count() > 64)
+        return false;
+
+    std::array<std::array<Square, 14>, 14> board {};
+    int castling_rights = 0;
+    bool is_valid = true;
+    occupied.for_each([&](int index) {
+        auto& square = board[index / 14][index % 14];
+        const auto code = reader.read(5);
+        if (code >= s_castling_rook_code) {
+            const int color = code - s_castling_rook_code;
+            const int right = castling_right_of_rook(color, index);
+            is_valid &= right != 0;
+            castling_rights |= right;
+            square.set_color(static_cast<Color>(color));
+            square.set_piece(Piece::Rook);
+        } else if (code >= s_en_passant_pawn_code) {
+            square.set_color(static_cast<Color>(code - s_en_passant_pawn_code));
+            square.set_piece(Piece::Pawn);
+            square.set_just_double_jumped(true);
+        } else {
+            square.set_color(static_cast<Color>(code / 6));
+            square.set_piece(static_cast<Piece>(code % 6));
+        }
+    });
+    return is_valid && game.set_position(board, static_cast<Color>(packed[0] & 3), packed[0] >> 2, castling_rights);
 }
 
+// Copies of positions are made at every node of a search and for every hosted game, so they must stay plain copies of bytes.
+static_assert(std::is_trivially_copyable_v<GameState>);
+
 GameState::GameState() {
     reset();
 }
 
 void GameState::reset() {
+    m_board = {};
+
     // Setup red.
     for (int x = 3; x < 11; ++x) {
         for (int y = 12; y < 14; ++y) {
-            m_board[x][y].color = Color::Red;
+            m_board[x][y].set_color(Color::Red);
         }
     }
-    m_board[3][13].piece = Piece::Rook;
-    m_board[4][13].piece = Piece::Knight;
-    m_board[5][13].piece = Piece::Bishop;
-    m_board[6][13].piece = Piece::Queen;
-    m_board[7][13].piece = Piece::King;
-    m_board[8][13].piece = Piece::Bishop;
-    m_board[9][13].piece = Piece::Knight;
-    m_board[10][13].piece = Piece::Rook;
+    m_board[3][13].set_piece(Piece::Rook);
+    m_board[4][13].set_piece(Piece::Knight);
+    m_board[5][13].set_piece(Piece::Bishop);
+    m_board[6][13].set_piece(Piece::Queen);
+    m_board[7][13].set_piece(Piece::King);
+    m_board[8][13].set_piece(Piece::Bishop);
+    m_board[9][13].set_piece(Piece::Knight);
+    m_board[10][13].set_piece(Piece::Rook);
     for (int i = 3; i < 11; ++i)
-        m_board[i][12].piece = Piece::Pawn;
+        m_board[i][12].set_piece(Piece::Pawn);
 
     // Setup blue.
     for (int x = 0; x < 2; ++x) {
         for (int y = 3; y < 11; ++y) {
-            m_board[x][y].color = Color::Blue;
+            m_board[x][y].set_color(Color::Blue);
         }
     }
-    m_board[0][3].piece = Piece::Rook;
-    m_board[0][4].piece = Piece::Knight;
-    m_board[0][5].piece = Piece::Bishop;
-    m_board[0][6].piece = Piece::King;
-    m_board[0][7].piece = Piece::Queen;
-    m_board[0][8].piece = Piece::Bishop;
-    m_board[0][9].piece = Piece::Knight;
-    m_board[0][10].piece = Piece::Rook;
+    m_board[0][3].set_piece(Piece::Rook);
+    m_board[0][4].set_piece(Piece::Knight);
+    m_board[0][5].set_piece(Piece::Bishop);
+    m_board[0][6].set_piece(Piece::King);
+    m_board[0][7].set_piece(Piece::Queen);
+    m_board[0][8].set_piece(Piece::Bishop);
+    m_board[0][9].set_piece(Piece::Knight);
+    m_board[0][10].set_piece(Piece::Rook);
     for (int i = 3; i < 11; ++i)
-        m_board[1][i].piece = Piece::Pawn;
+        m_board[1][i].set_piece(Piece::Pawn);
 
     // Setup yellow.
     for (int x = 3; x < 11; ++x) {
         for (int y = 0; y < 2; ++y) {
-            m_board[x][y].color = Color::Yellow;
+            m_board[x][y].set_color(Color::Yellow);
         }
     }
-    m_board[3][0].piece = Piece::Rook;
-    m_board[4][0].piece = Piece::Knight;
-    m_board[5][0].piece = Piece::Bishop;
-    m_board[6][0].piece = Piece::King;
-    m_board[7][0].piece = Piece::Queen;
-    m_board[8][0].piece = Piece::Bishop;
-    m_board[9][0].piece = Piece::Knight;
-    m_board[10][0].piece = Piece::Rook;
+    m_board[3][0].set_piece(Piece::Rook);
+    m_board[4][0].set_piece(Piece::Knight);
+    m_board[5][0].set_piece(Piece::Bishop);
+    m_board[6][0].set_piece(Piece::King);
+    m_board[7][0].set_piece(Piece::Queen);
+    m_board[8][0].set_piece(Piece::Bishop);
+    m_board[9][0].set_piece(Piece::Knight);
+    m_board[10][0].set_piece(Piece::Rook);
     for (int i = 3; i < 11; ++i)
-        m_board[i][1].piece = Piece::Pawn;
+        m_board[i][1].set_piece(Piece::Pawn);
 
     // Setup green.
     for (int x = 12; x < 14; ++x) {
         for (int y = 3; y < 11; ++y) {
-            m_board[x][y].color = Color::Green;
+            m_board[x][y].set_color(Color::Green);
         }
     }
-    m_board[13][3].piece = Piece::Rook;
-    m_board[13][4].piece = Piece::Knight;
-    m_board[13][5].piece = Piece::Bishop;
-    m_board[13][6].piece = Piece::Queen;
-    m_board[13][7].piece = Piece::King;
-    m_board[13][8].piece = Piece::Bishop;
-    m_board[13][9].piece = Piece::Knight;
-    m_board[13][10].piece = Piece::Rook;
+    m_board[13][3].set_piece(Piece::Rook);
+    m_board[13][4].set_piece(Piece::Knight);
+    m_board[13][5].set_piece(Piece::Bishop);
+    m_board[13][6].set_piece(Piece::Queen);
+    m_board[13][7].set_piece(Piece::King);
+    m_board[13][8].set_piece(Piece::Bishop);
+    m_board[13][9].set_piece(Piece::Knight);
+    m_board[13][10].set_piece(Piece::Rook);
     for (int i = 3; i < 11; ++i)
-        m_board[12][i].piece = Piece::Pawn;
+        m_board[12][i].set_piece(Piece::Pawn);
+
+    set_position(m_board, Color::Red, 0xf, 0xff);
+}
+
+bool GameState::set_position(std::array<std::array<Square, 14>, 14> board, Color player, int remaining_players, int castling_rights) {
+    if (remaining_players < 0 || remaining_players > 0xf || !(remaining_players & (1 << static_cast<int>(player))))
+        return false;
+
+    // Validating and filling in the bitboards and piece lists in one go, then counting the attacks once, is much cheaper
+    // than placing the pieces one at a time.
+    std::array<Bitboard, 6> piece_bitboards {};
+    std::array<Bitboard, 4> color_bitboards {};
+    Bitboard occupied {};
+    std::array<PieceList, 4> piece_lists {};
+    std::array<std::uint8_t, 196> piece_list_slots {};
+    std::array<int, 4> king_counts {};
+    std::array<int, 4> en_passant_counts {};
+    auto king_positions = s_initial_king_positions;
+    for (int index = 0; index < 196; ++index) {
+        auto& square = board[index / 14][index % 14];
+        square.set_has_moved(false);
+        if (square.piece().has_value() != square.color().has_value())
+            return false;
+        if (!square.piece().has_value()) {
+            if (square.just_double_jumped())
+                return false;
+            continue;
+        }
+        const auto piece = square.piece().value();
+        const int color = static_cast<int>(square.color().value());
+        auto& list = piece_lists[color];
+        if (!s_board_tables.playable.test(index) || list.m_size == PieceList::capacity)
+            return false;
+        if (piece == Piece::King) {
+            ++king_counts[color];
+            king_positions[color] = point_from_index(index);
+        }
+        // Only the pawn a player double jumped with on their last turn can be taken en passant.
+        if (square.just_double_jumped()) {
+            const bool has_double_jumped = with_color_traits(square.color().value(), [&](auto traits) { return decltype(traits)::rank_of(index) == decltype(traits)::double_jump_rank; });
+            if (piece != Piece::Pawn || !has_double_jumped || ++en_passant_counts[color] > 1)
+                return false;
+        }
+
+        piece_bitboards[static_cast<int>(piece)].set(index);
+        color_bitboards[color].set(index);
+        occupied.set(index);
+        piece_list_slots[index] = list.m_size;
+        list.m_entries[list.m_size++] = {piece, static_cast<std::uint8_t>(index)};
+        ++list.m_counts[static_cast<int>(piece)];
+    }
+
+    for (int color = 0; color < 4; ++color) {
+        if (king_counts[color] > 1 || (king_counts[color] == 0 && (remaining_players & (1 << color))))
+            return false;
+        // The rights follow from which kings and rooks have moved, so a rook on its initial square without its right is marked as moved.
+        const auto& king = board[s_initial_king_positions[color].x][s_initial_king_positions[color].y];
+        const bool king_is_home = king.piece() == Piece::King && king.color() == static_cast<Color>(color);
+        for (int option = 0; option < 2; ++option) {
+            const auto& rook_origin = s_castling_options[color][option].rook_origin;
+            auto& rook = board[rook_origin.x][rook_origin.y];
+            const bool rook_is_home = rook.piece() == Piece::Rook && rook.color() == static_cast<Color>(color);
+            if (castling_rights & (1 << (2 * color + option))) {
+                if (!king_is_home || !rook_is_home)
+                    return false;
+            } else if (rook_is_home) {
+                rook.set_has_moved(true);
+            }
+        }
+    }
+
+    m_player = player;
+    m_current_players = PlayerSet(remaining_players);
+    m_king_positions = king_positions;
+    m_board = board;
+    m_piece_bitboards = piece_bitboards;
+    m_color_bitboards = color_bitboards;
+    m_occupied = occupied;
+    m_piece_lists = piece_lists;
+    m_piece_list_slots = piece_list_slots;
+    count_attacks(m_attack_counts);
+    m_hash = compute_hash();
+    m_evaluator = compute_evaluator();
+    if (m_network)
+        m_accumulators = compute_accumulators();
+    verify_incremental_state();
+    return true;
 }
 
 const std::array<std::array<Square, 14>, 14>& GameState::get_board() const {
     return m_board;
 }
 
-std::array<std::array<Square, 14>, 14>& GameState::get_board() {
-    return m_board;
+const Bitboard& GameState::get_piece_bitboard(Piece piece) const {
+    return m_piece_bitboards[static_cast<int>(piece)];
+}
+
+const Bitboard& GameState::get_color_bitboard(Color color) const {
+    return m_color_bitboards[static_cast<int>(color)];
+}
+
+const Bitboard& GameState::get_occupied_squares() const {
+    return m_occupied;
+}
+
+const PieceList& GameState::get_pieces(Color color) const {
+    return m_piece_lists[static_cast<int>(color)];
+}
+
+void GameState::set_square(const Point& position, const Square& square) {
+    const int index = square_index(position);
+    auto& current = m_board[position.x][position.y];
+    const bool affects_castling = s_zobrist_keys.castling_squares.test(index);
+    if (affects_castling)
+        m_hash ^= s_zobrist_keys.castling[castling_rights()];
+    if (current.just_double_jumped())
+        m_hash ^= s_zobrist_keys.en_passant[index];
+    if (current.piece().has_value()) {
+        m_hash ^= s_zobrist_keys.pieces[static_cast<int>(current.piece().value())][static_cast<int>(current.color().value())][index];
+        update_attacks_from(index, current.piece().value(), current.color().value(), -1);
+        m_piece_bitboards[static_cast<int>(current.piece().value())].reset(index);
+        m_color_bitboards[static_cast<int>(current.color().value())].reset(index);
+        m_occupied.reset(index);
+        update_rays_through(index, 1);
+        update_evaluator(index, current.piece().value(), current.color().value(), -1);
+        if (m_network)
+            m_network->remove_features(m_accumulators, network_features(index, current.piece().value(), current.color().value()));
+
+        // Fill the gap with the last entry of the list.
+        auto& list = m_piece_lists[static_cast<int>(current.color().value())];
+        const auto slot = m_piece_list_slots[index];
+        list.m_entries[slot] = list.m_entries[--list.m_size];
+        m_piece_list_slots[list.m_entries[slot].index] = slot;
+        --list.m_counts[static_cast<int>(current.piece().value())];
+    }
+    current = square;
+    if (current.piece().has_value()) {
+        update_rays_through(index, -1);
+        m_piece_bitboards[static_cast<int>(current.piece().value())].set(index);
+        m_color_bitboards[static_cast<int>(current.color().value())].set(index);
+        m_occupied.set(index);
+        update_attacks_from(index, current.piece().value(), current.color().value(), 1);
+        update_evaluator(index, current.piece().value(), current.color().value(), 1);
+        if (m_network)
+            m_network->add_features(m_accumulators, network_features(index, current.piece().value(), current.color().value()));
+
+        auto& list = m_piece_lists[static_cast<int>(current.color().value())];
+        m_piece_list_slots[index] = list.m_size;
+        list.m_entries[list.m_size++] = {current.piece().value(), static_cast<std::uint8_t>(index)};
+        ++list.m_counts[static_cast<int>(current.piece().value())];
+        m_hash ^= s_zobrist_keys.pieces[static_cast<int>(current.piece().value())][static_cast<int>(current.color().value())][index];
+    }
+    if (current.just_double_jumped())
+        m_hash ^= s_zobrist_keys.en_passant[index];
+    if (affects_castling)
+        m_hash ^= s_zobrist_keys.castling[castling_rights()];
+}
+
+// Expects the bitboards to include the change already.
+void GameState::update_evaluator(int index, Piece piece, Color color, int delta) {
+    const int color_index = static_cast<int>(color);
+    m_evaluator.m_material[color_index] += delta * s_material_values[static_cast<int>(piece)];
+    m_evaluator.m_piece_square[color_index] += delta * s_piece_square_tables.values[color_index][static_cast<int>(piece)][index];
+    if (piece == Piece::King) {
+        m_evaluator.m_king_safety[color_index] = king_shelter(color);
+    } else if (piece == Piece::Pawn) {
+        const auto king = m_piece_bitboards[static_cast<int>(Piece::King)] & m_color_bitboards[color_index];
+        if (king.any() && s_board_tables.king_attacks[king.lsb()].test(index))
+            m_evaluator.m_king_safety[color_index] += delta * s_shelter_value;
+    }
+}
+
+int GameState::king_shelter(Color color) const {
+    const auto& own_pieces = m_color_bitboards[static_cast<int>(color)];
+    const auto king = m_piece_bitboards[static_cast<int>(Piece::King)] & own_pieces;
+    if (king.none())
+        return 0;
+    return (s_board_tables.king_attacks[king.lsb()] & m_piece_bitboards[static_cast<int>(Piece::Pawn)] & own_pieces).count() * s_shelter_value;
+}
+
+Evaluator GameState::compute_evaluator() const {
+    Evaluator evaluator;
+    for (int color = 0; color < 4; ++color) {
+        for (const auto& entry : m_piece_lists[color]) {
+            evaluator.m_material[color] += s_material_values[static_cast<int>(entry.piece)];
+            evaluator.m_piece_square[color] += s_piece_square_tables.values[color][static_cast<int>(entry.piece)][entry.index];
+        }
+        evaluator.m_king_safety[color] = king_shelter(static_cast<Color>(color));
+    }
+    return evaluator;
+}
+
+void GameState::set_network(const Network* network) {
+    m_network = network;
+    if (m_network)
+        m_accumulators = compute_accumulators();
+}
+
+std::array<int, 4> GameState::evaluate_network() const {
+    std::array<int, 4> outputs;
+    for (int color = 0; color < 4; ++color)
+        outputs[color] = m_network->evaluate(m_accumulators[color]);
+    return outputs;
+}
+
+std::array<Network::Accumulator, 4> GameState::compute_accumulators() const {
+    std::array<Network::Accumulator, 4> accumulators;
+    m_network->reset(accumulators);
+    for (int color = 0; color < 4; ++color) {
+        for (const auto& entry : m_piece_lists[color])
+            m_network->add_features(accumulators, network_features(entry.index, entry.piece, static_cast<Color>(color)));
+    }
+    return accumulators;
+}
+
+// The feature of a piece as seen by each color.
+std::array<int, 4> GameState::network_features(int index, Piece piece, Color color) const {
+    std::array<int, 4> features;
+    for (int perspective = 0; perspective < 4; ++perspective)
+        features[perspective] = Network::feature_index(static_cast<int>(piece), (static_cast<int>(color) - perspective) & 3, s_network_squares[perspective][index]);
+    return features;
+}
+
+void GameState::set_just_double_jumped(const Point& position, bool just_double_jumped) {
+    auto& square = m_board[position.x][position.y];
+    if (square.just_double_jumped() == just_double_jumped)
+        return;
+    square.set_just_double_jumped(just_double_jumped);
+    m_hash ^= s_zobrist_keys.en_passant[square_index(position)];
+}
+
+// The squares attacked by the given piece if it stood on 'index', with sliders blocked by 'occupied'.
+Bitboard GameState::attacks_from(int index, Piece piece, Color color, const Bitboard& occupied) const {
+    auto slide = [&](int first_direction, int last_direction) {
+        Bitboard attacks {};
+        for (int direction = first_direction; direction <= last_direction; ++direction) {
+            auto ray = s_board_tables.rays[direction][index];
+            const auto blockers = ray & occupied;
+            if (blockers.any())
+                ray &= ~s_board_tables.rays[direction][direction_is_ascending(s_directions[direction]) ? blockers.lsb() : blockers.msb()];
+            attacks |= ray;
+        }
+        return attacks;
+    };
+
+    switch (piece) {
+        case Piece::Queen:
+            return slide(0, 7);
+        case Piece::Rook:
+            return slide(0, 3);
+        case Piece::Bishop:
+            return slide(4, 7);
+        case Piece::Knight:
+            return s_board_tables.knight_attacks[index];
+        case Piece::King:
+            return s_board_tables.king_attacks[index];
+        case Piece::Pawn:
+            return s_board_tables.pawn_attacks[static_cast<int>(color)][index];
+        default:
+            __builtin_unreachable();
+    }
+}
+
+void GameState::update_attacks_from(int index, Piece piece, Color color, int delta) {
+    auto& counts = m_attack_counts[static_cast<int>(color)];
+    attacks_from(index, piece, color, m_occupied).for_each([&](int attacked) {
+        counts[attacked] += delta;
+    });
+}
+
+// Sliders whose rays reach 'index' continue past it once it is vacated (positive 'delta') and stop there once it is filled (negative 'delta').
+// Expects 'index' to be empty in 'm_occupied' when called.
+void GameState::update_rays_through(int index, int delta) {
+    const auto& queens = m_piece_bitboards[static_cast<int>(Piece::Queen)];
+    const auto rooks_and_queens = m_piece_bitboards[static_cast<int>(Piece::Rook)] | queens;
+    const auto bishops_and_queens = m_piece_bitboards[static_cast<int>(Piece::Bishop)] | queens;
+    for (int direction = 0; direction < 8; ++direction) {
+        const auto blockers = s_board_tables.rays[direction][index] & m_occupied;
+        if (blockers.none())
+            continue;
+        const int slider = direction_is_ascending(s_directions[direction]) ? blockers.lsb() : blockers.msb();
+        if (!(direction < 4 ? rooks_and_queens : bishops_and_queens).test(slider))
+            continue;
+
+        // The slider looks back through 'index' in the opposite direction.
+        const int onward_direction = direction ^ 1;
+        auto ray = s_board_tables.rays[onward_direction][index];
+        const auto onward_blockers = ray & m_occupied;
+        if (onward_blockers.any())
+            ray &= ~s_board_tables.rays[onward_direction][direction_is_ascending(s_directions[onward_direction]) ? onward_blockers.lsb() : onward_blockers.msb()];
+        auto& counts = m_attack_counts[static_cast<int>(m_board[slider / 14][slider % 14].color().value())];
+        ray.for_each([&](int attacked) {
+            counts[attacked] += delta;
+        });
+    }
+}
+
+int GameState::get_attack_count(Point position, Color attacker) const {
+    return m_attack_counts[static_cast<int>(attacker)][square_index(position)];
+}
+
+// Counts the attacks of every piece on the board from scratch.
+void GameState::count_attacks(std::array<std::array<std::uint8_t, 196>, 4>& counts) const {
+    counts = {};
+    m_occupied.for_each([&](int index) {
+        const auto& square = m_board[index / 14][index % 14];
+        attacks_from(index, square.piece().value(), square.color().value(), m_occupied).for_each([&](int attacked) {
+            ++counts[static_cast<int>(square.color().value())][attacked];
+        });
+    });
+}
+
+bool GameState::attack_maps_are_consistent() const {
+    std::array<std::array<std::uint8_t, 196>, 4> expected;
+    count_attacks(expected);
+    return expected == m_attack_counts;
+}
+
+bool GameState::piece_lists_are_consistent() const {
+    int size = 0;
+    for (int color = 0; color < 4; ++color) {
+        const auto& list = m_piece_lists[color];
+        std::array<std::uint8_t, 6> counts {};
+        for (int slot = 0; slot < list.size(); ++slot) {
+            const auto& square = m_board[list[slot].index / 14][list[slot].index % 14];
+            if (square.piece() != list[slot].piece || square.color() != static_cast<Color>(color) || m_piece_list_slots[list[slot].index] != slot)
+                return false;
+            ++counts[static_cast<int>(list[slot].piece)];
+        }
+        if (counts != list.m_counts)
+            return false;
+        size += list.size();
+    }
+    return size == m_occupied.count();
+}
+
+std::uint64_t GameState::get_hash() const {
+    return m_hash;
+}
+
+// Bit '2 * color + option' is set if that castling option is still available, as far as unmoved pieces are concerned.
+int GameState::castling_rights() const {
+    int rights = 0;
+    for (int color = 0; color < 4; ++color) {
+        const auto& king = m_board[s_initial_king_positions[color].x][s_initial_king_positions[color].y];
+        if (king.piece() != Piece::King || king.color() != static_cast<Color>(color) || king.has_moved())
+            continue;
+        for (int option = 0; option < 2; ++option) {
+            const auto& rook_origin = s_castling_options[color][option].rook_origin;
+            const auto& rook = m_board[rook_origin.x][rook_origin.y];
+            if (rook.piece() == Piece::Rook && rook.color() == static_cast<Color>(color) && !rook.has_moved())
+                rights |= 1 << (2 * color + option);
+        }
+    }
+    return rights;
+}
+
+std::uint64_t GameState::compute_hash() const {
+    std::uint64_t hash = s_zobrist_keys.side_to_move[static_cast<int>(m_player)] ^ s_zobrist_keys.castling[castling_rights()];
+    m_occupied.for_each([&](int index) {
+        const auto& square = m_board[index / 14][index % 14];
+        hash ^= s_zobrist_keys.pieces[static_cast<int>(square.piece().value())][static_cast<int>(square.color().value())][index];
+    });
+    playable_squares().for_each([&](int index) {
+        if (m_board[index / 14][index % 14].just_double_jumped())
+            hash ^= s_zobrist_keys.en_passant[index];
+    });
+    for (int color = 0; color < 4; ++color) {
+        if (!player_exists(static_cast<Color>(color)))
+            hash ^= s_zobrist_keys.eliminated[color];
+    }
+    return hash;
+}
+
+void GameState::verify_incremental_state() const {
+#ifdef FPC_VERIFY_INCREMENTAL_STATE
+    if (!attack_maps_are_consistent()) {
+        std::cerr << "Attack maps are out of sync with the board!\n";
+        std::terminate();
+    }
+    if (!piece_lists_are_consistent()) {
+        std::cerr << "Piece lists are out of sync with the board!\n";
+        std::terminate();
+    }
+    if (m_hash != compute_hash()) {
+        std::cerr << "Position hash is out of sync with the board!\n";
+        std::terminate();
+    }
+    if (m_evaluator != compute_evaluator()) {
+        std::cerr << "Evaluation terms are out of sync with the board!\n";
+        std::terminate();
+    }
+    if (m_network && m_accumulators != compute_accumulators()) {
+        std::cerr << "Network accumulators are out of sync with the board!\n";
+        std::terminate();
+    }
+#endif
 }
 
 bool GameState::point_is_of_color(const Point& point, const Color color) const {
-    if (!m_board[point.x][point.y].color.has_value())
+    if (!m_board[point.x][point.y].color().has_value())
         return false;
-    return m_board[point.x][point.y].color.value() == color;
+    return m_board[point.x][point.y].color().value() == color;
 }
 
 void get_piece_name(const GameState& game, int x, int y) {
-    if (!game.get_board()[x][y].piece.has_value()) {
+    if (!game.get_board()[x][y].piece().has_value()) {
         std::cout << "No value.\n";
         return;
     }
-    switch (game.get_board()[x][y].piece.value()) {
+    switch (game.get_board()[x][y].piece().value()) {
         case Piece::Rook:
             std::cout << "Rook\n";
             break;
@@ -131,531 +1219,767 @@ void get_piece_name(const GameState& game, int x, int y) {
     }
 }
 
-void GameState::iterate_from(std::vector<Point>& valid_moves, const Color player, const Point& original_position, const Point& increment_map) const {
-    int x = original_position.x;
-    int y = original_position.y;
-    while (is_valid_position({x += increment_map.x, y += increment_map.y})) {
-        if (m_board[x][y].piece.has_value() && !point_is_of_color({x, y}, player)) {
-            valid_moves.push_back({x, y});
+void GameState::iterate_from(MoveList& valid_moves, const Color player, const Point& original_position, int direction) const {
+    const int origin = square_index(original_position);
+    const auto& own_pieces = m_color_bitboards[static_cast<int>(player)];
+    for (const auto* target = s_square_lists.rays[direction][origin].data(); *target != s_no_square; ++target) {
+        if (m_occupied.test(*target)) {
+            // Either this is a capture, or another piece that is owned by the player. The path ends here regardless.
+            if (!own_pieces.test(*target))
+                valid_moves.push_back({origin, *target, Move::Capture});
             break;
         }
-        // This is another piece that is owned by the player. The path ends here.
-        if (m_board[x][y].piece.has_value() && point_is_of_color({x, y}, player))
-            break;
 
-        valid_moves.push_back({x, y});
-        continue;
+        valid_moves.push_back({origin, *target});
     }
 }
 
 bool GameState::empty_square(const Point& square) {
     if (!is_valid_position(square))
         return false;
-    m_board[square.x][square.y].has_moved = false;
-    m_board[square.x][square.y].piece = std::nullopt;
-    m_board[square.x][square.y].color = std::nullopt;
+    auto emptied = m_board[square.x][square.y];
+    emptied.set_has_moved(false);
+    emptied.set_just_double_jumped(false);
+    emptied.set_piece(std::nullopt);
+    emptied.set_color(std::nullopt);
+    set_square(square, emptied);
     return true;
 }
 
 bool GameState::may_promote(const Point& position, const Color& player) const {
-    if (!is_valid_position(position) || !m_board[position.x][position.y].piece.has_value() || m_board[position.x][position.y].piece.value() != Piece::Pawn || !m_board[position.x][position.y].color.has_value() || m_board[position.x][position.y].color.value() != player)
+    if (!is_valid_position(position) || !m_board[position.x][position.y].piece().has_value() || m_board[position.x][position.y].piece().value() != Piece::Pawn || !m_board[position.x][position.y].color().has_value() || m_board[position.x][position.y].color().value() != player)
         return false;
-    switch (player) {
-        case Color::Red:
-            if (position.y == 0)
-                return true;
-            return false;
-        case Color::Blue:
-            if (position.x == 13)
-                return true;
-            return false;
-        case Color::Yellow:
-            if (position.y == 13)
-                return true;
-            return false;
-        case Color::Green:
-            if (position.x == 0)
-                return true;
-            return false;
-        default:
-            __builtin_unreachable();
-    }
+    return is_promotion_square(position, player);
+}
+
+bool GameState::promote(const Point& position, Piece piece) {
+    if (piece == Piece::King || piece == Piece::Pawn || !m_board[position.x][position.y].color().has_value() || !may_promote(position, m_board[position.x][position.y].color().value()))
+        return false;
+    auto promoted = m_board[position.x][position.y];
+    promoted.set_piece(piece);
+    set_square(position, promoted);
+    verify_incremental_state();
+    return true;
 }
 
 void GameState::unsafe_move_piece_to(const Point& origin, const Point& destination) {
-    m_board[destination.x][destination.y].piece = m_board[origin.x][origin.y].piece;
-    m_board[destination.x][destination.y].color = m_board[origin.x][origin.y].color;
-    m_board[destination.x][destination.y].has_moved = true;
+    auto moved = m_board[destination.x][destination.y];
+    moved.set_piece(m_board[origin.x][origin.y].piece());
+    moved.set_color(m_board[origin.x][origin.y].color());
+    moved.set_has_moved(true);
+    moved.set_just_double_jumped(false);
+    // Emptying the origin first means the piece list never has to hold the moving piece twice.
     empty_square(origin);
+    set_square(destination, moved);
 }
 
-void GameState::complete_castling_if_needed(FPC::Point origin, FPC::Point destination) {
-    if (m_board[destination.x][destination.y].piece == FPC::Piece::King && (std::abs(destination.x - origin.x) == 2 || std::abs(destination.y - origin.y) == 2)) {
-        switch (m_player) {
-            case Color::Red:
-                if (destination.x == 5)
-                    unsafe_move_piece_to({3, 13}, {6, 13});
-                else if (destination.x == 9)
-                    unsafe_move_piece_to({10, 13}, {8, 13});
-                break;
-            case Color::Blue:
-                if (destination.y == 4)
-                    unsafe_move_piece_to({0, 3}, {0, 5});
-                else if (destination.y == 8)
-                    unsafe_move_piece_to({0, 10}, {0, 7});
-                break;
-            case Color::Yellow:
-                if (destination.x == 4)
-                    unsafe_move_piece_to({3, 0}, {5, 0});
-                else if (destination.x == 8)
-                    unsafe_move_piece_to({10, 0}, {7, 0});
-                break;
-            case Color::Green:
-                if (destination.y == 5)
-                    unsafe_move_piece_to({13, 3}, {13, 6});
-                else if (destination.y == 9)
-                    unsafe_move_piece_to({13, 10}, {13, 8});
-                break;
-        }
+// Expects the king to have been moved to 'destination' already.
+std::optional<std::pair<Point, Point>> GameState::castling_rook_move(FPC::Point origin, FPC::Point destination) const {
+    if (m_board[destination.x][destination.y].piece() != FPC::Piece::King || (std::abs(destination.x - origin.x) != 2 && std::abs(destination.y - origin.y) != 2))
+        return std::nullopt;
+
+    for (const auto& option : s_castling_options[static_cast<int>(m_board[destination.x][destination.y].color().value())]) {
+        if (option.king_destination == destination)
+            return std::pair {option.rook_origin, option.rook_destination};
     }
+    return std::nullopt;
 }
 
-bool GameState::move_piece_to(const Point& origin, const Point& destination, bool enforce_king_protection) {
-    if (!m_board[origin.x][origin.y].piece.has_value() || !m_board[origin.x][origin.y].color.has_value() || !is_valid_position(origin) || !is_valid_position(destination))
-        return false;
-    bool is_valid_move = false;
-    auto valid_moves = get_valid_moves_for_position(origin, m_board[origin.x][origin.y].color.value(), enforce_king_protection);
-    for (const auto& move : valid_moves) {
-        if (move == destination)
-            is_valid_move = true;
-    }
-    if (!is_valid_move)
-        return false;
-    auto initial_origin_piece = m_board[origin.x][origin.y].piece;
-    auto initial_destination_piece = m_board[destination.x][destination.y].piece;
+MoveUndo GameState::make_move(const Point& origin, const Point& destination) {
+    const Color player = m_board[origin.x][origin.y].color().value();
+    MoveUndo undo {};
+    undo.origin = origin;
+    undo.destination = destination;
+    undo.moved = m_board[origin.x][origin.y];
+    undo.captured = m_board[destination.x][destination.y];
+    undo.king_position = m_king_positions[static_cast<int>(player)];
+    undo.hash = m_hash;
+
     unsafe_move_piece_to(origin, destination);
 
-    if (m_board[destination.x][destination.y].piece == FPC::Piece::Pawn) {
+    if (m_board[destination.x][destination.y].piece() == FPC::Piece::Pawn) {
         if (std::max(origin.x, destination.x) - std::min(origin.x, destination.x) == 2 || std::max(origin.y, destination.y) - std::min(origin.y, destination.y) == 2)
-            m_board[destination.x][destination.y].just_double_jumped = true;
+            set_just_double_jumped(destination, true);
     }
 
     // Check for "en passant"
-    if (initial_origin_piece.value() == FPC::Piece::Pawn && !initial_destination_piece.has_value()) {
-        if ((m_player == Color::Blue || m_player == Color::Green) && origin.y != destination.y)
-            empty_square({origin.x, destination.y});
-        else if ((m_player == Color::Red || m_player == Color::Yellow) && origin.x != destination.x)
-            empty_square({destination.x, origin.y});
+    if (undo.moved.piece().value() == FPC::Piece::Pawn && !undo.captured.piece().has_value()) {
+        if ((player == Color::Blue || player == Color::Green) && origin.y != destination.y)
+            undo.en_passant_square = Point {origin.x, destination.y};
+        else if ((player == Color::Red || player == Color::Yellow) && origin.x != destination.x)
+            undo.en_passant_square = Point {destination.x, origin.y};
+        if (undo.en_passant_square.has_value()) {
+            undo.en_passant_captured = m_board[undo.en_passant_square.value().x][undo.en_passant_square.value().y];
+            empty_square(undo.en_passant_square.value());
+        }
     }
 
-    complete_castling_if_needed(origin, destination);
+    undo.castling_rook = castling_rook_move(origin, destination);
+    if (undo.castling_rook.has_value()) {
+        const auto& [rook_origin, rook_destination] = undo.castling_rook.value();
+        undo.castling_squares = {m_board[rook_origin.x][rook_origin.y], m_board[rook_destination.x][rook_destination.y]};
+        unsafe_move_piece_to(rook_origin, rook_destination);
+    }
 
     // Store positions of kings.
-    if (m_board[destination.x][destination.y].piece == FPC::Piece::King)
-        m_king_positions[static_cast<int>(m_player)] = destination;
+    if (m_board[destination.x][destination.y].piece() == FPC::Piece::King)
+        m_king_positions[static_cast<int>(player)] = destination;
 
-    return true;
+    verify_incremental_state();
+    return undo;
 }
 
-void GameState::advance_turn() {
-    for (std::vector<FPC::Color>::size_type i = 0; i < m_current_players.size(); ++i) {
-        if (m_current_players[i] == m_player) {
-            if (i != m_current_players.size() - 1)
-                m_player = m_current_players[i + 1];
-            else
-                m_player = m_current_players[0];
-            break;
-        }
+MoveUndo GameState::make_move(const Move& move) {
+    const auto destination = move.destination();
+    auto undo = make_move(move.origin(), destination);
+    if (move.promotion().has_value()) {
+        auto promoted = m_board[destination.x][destination.y];
+        promoted.set_piece(move.promotion());
+        set_square(destination, promoted);
+        verify_incremental_state();
     }
+    return undo;
+}
 
-    switch (m_player) {
-        case FPC::Color::Red:
-            for (int i = 3; i < 11; ++i)
-                m_board[i][10].just_double_jumped = false;
-            break;
-        case FPC::Color::Blue:
-            for (int i = 3; i < 11; ++i)
-                m_board[3][i].just_double_jumped = false;
-            break;
-        case FPC::Color::Yellow:
-            for (int i = 3; i < 11; ++i)
-                m_board[i][3].just_double_jumped = false;
-            break;
-        case FPC::Color::Green:
-            for (int i = 3; i < 11; ++i)
-                m_board[10][i].just_double_jumped = false;
-            break;
+void GameState::unmake_move(const MoveUndo& undo) {
+    if (undo.castling_rook.has_value()) {
+        const auto& [rook_origin, rook_destination] = undo.castling_rook.value();
+        set_square(rook_destination, undo.castling_squares.second);
+        set_square(rook_origin, undo.castling_squares.first);
     }
+    if (undo.en_passant_square.has_value())
+        set_square(undo.en_passant_square.value(), undo.en_passant_captured);
+    set_square(undo.destination, undo.captured);
+    set_square(undo.origin, undo.moved);
+    m_king_positions[static_cast<int>(undo.moved.color().value())] = undo.king_position;
+    m_hash = undo.hash;
+    verify_incremental_state();
+}
 
-    auto analyze_square = [&](Point current_position, Color test_player) -> std::optional<bool> {
-        if (m_board[current_position.x][current_position.y].color.has_value() && m_board[current_position.x][current_position.y].color.value() == test_player)
-            return !get_valid_moves_for_position(current_position, test_player, true).empty();
-        return std::nullopt;
-    };
+bool GameState::move_piece_to(const Point& origin, const Point& destination, bool enforce_king_protection) {
+    if (!m_board[origin.x][origin.y].piece().has_value() || !m_board[origin.x][origin.y].color().has_value() || !is_valid_position(origin) || !is_valid_position(destination))
+        return false;
+    bool is_valid_move = false;
+    MoveList valid_moves;
+    get_valid_moves_for_position(origin, m_board[origin.x][origin.y].color().value(), enforce_king_protection, valid_moves);
+    for (const auto& move : valid_moves) {
+        if (move.destination() == destination)
+            is_valid_move = true;
+    }
+    if (!is_valid_move)
+        return false;
+    make_move(origin, destination);
+    return true;
+}
 
-    std::vector<Color> checkmated_players {};
-    for (const auto& test_player : m_current_players) {
-        bool player_is_checkmated = true;
+void GameState::advance_turn() {
+    advance_turn(nullptr);
+}
 
-        for (int x = 3; x < 11; ++x) {
-            for (int y = 0; y < 3; ++y) {
-                auto analysis = analyze_square({x, y}, test_player);
-                if (analysis.has_value() && analysis.value())
-                    player_is_checkmated = false;
-            }
-        }
+void GameState::advance_turn(MoveList& legal_moves) {
+    advance_turn(&legal_moves);
+}
 
-        for (int x = 3; x < 11; ++x) {
-            for (int y = 11; y < 14; ++y) {
-                auto analysis = analyze_square({x, y}, test_player);
-                if (analysis.has_value() && analysis.value())
-                    player_is_checkmated = false;
-            }
-        }
+void GameState::advance_turn(MoveList* legal_moves) {
+    m_hash ^= s_zobrist_keys.side_to_move[static_cast<int>(m_player)];
+    m_player = m_current_players.next_after(m_player);
+    m_hash ^= s_zobrist_keys.side_to_move[static_cast<int>(m_player)];
 
-        for (int x = 0; x < 14; ++x) {
-            for (int y = 3; y < 11; ++y) {
-                auto analysis = analyze_square({x, y}, test_player);
-                if (analysis.has_value() && analysis.value())
-                    player_is_checkmated = false;
-            }
-        }
+    with_color_traits(m_player, [&](auto traits) {
+        using Traits = decltype(traits);
+        for (int i = 3; i < 11; ++i)
+            set_just_double_jumped(Traits::capture_axis == Axis::X ? Point {i, Traits::double_jump_rank} : Point {Traits::double_jump_rank, i}, false);
+    });
 
+    // Which player 'legal_moves' holds the moves of, if any.
+    std::optional<Color> generated_for {};
+    PlayerSet checkmated_players;
+    for (const auto& test_player : m_current_players) {
+        bool player_is_checkmated = false;
         auto king_position = m_board[m_king_positions[static_cast<int>(test_player)].x][m_king_positions[static_cast<int>(test_player)].y];
-        if (!king_position.color.has_value() || king_position.color.value() != test_player)
+        if (!king_position.color().has_value() || king_position.color().value() != test_player) {
             player_is_checkmated = true; // In truth, the king has been captured, but here it means the same thing.
+        } else if (legal_moves && test_player == m_player) {
+            // The caller wants these moves anyway, so they might as well decide whether the player is checkmated.
+            legal_moves->clear();
+            generate_legal_moves(test_player, *legal_moves);
+            generated_for = test_player;
+            player_is_checkmated = legal_moves->empty();
+        } else if (is_attacked(square_index(m_king_positions[static_cast<int>(test_player)]), test_player) || !has_obviously_legal_move(test_player)) {
+            player_is_checkmated = !has_legal_move(test_player);
+        }
 
         if (player_is_checkmated) {
             if (m_player == test_player) {
-                std::vector<FPC::Color>::size_type test_player_index = 0;
-                for (; test_player_index < m_current_players.size(); ++test_player_index) {
-                    if (m_current_players[test_player_index] == test_player)
-                        break;
-                }
-                if (test_player != m_current_players.back())
-                    m_player = m_current_players[test_player_index + 1];
-                else
-                    m_player = m_current_players[0];
+                m_hash ^= s_zobrist_keys.side_to_move[static_cast<int>(m_player)];
+                m_player = m_current_players.next_after(test_player);
+                m_hash ^= s_zobrist_keys.side_to_move[static_cast<int>(m_player)];
             }
-            checkmated_players.push_back(test_player);
+            checkmated_players.insert(test_player);
         }
     }
-    if (checkmated_players.size() > 0) {
-        for (const auto& player : checkmated_players)
-            m_current_players.erase(std::remove(m_current_players.begin(), m_current_players.end(), player), m_current_players.end());
+    for (const auto player : checkmated_players) {
+        m_current_players.erase(player);
+        m_hash ^= s_zobrist_keys.eliminated[static_cast<int>(player)];
+    }
+    // Eliminated players no longer threaten anyone, which may have made more moves legal.
+    if (legal_moves && (!checkmated_players.empty() || generated_for != m_player)) {
+        legal_moves->clear();
+        if (m_current_players.size() > 1)
+            generate_legal_moves(m_player, *legal_moves);
     }
+    verify_incremental_state();
 }
 
 Color GameState::get_current_player() const {
     return m_player;
 }
 
-const std::vector<Color>& GameState::get_current_players() const {
+PlayerSet GameState::get_current_players() const {
     return m_current_players;
 }
 
 bool GameState::player_exists(Color player) const {
-    return std::find(m_current_players.begin(), m_current_players.end(), player) != m_current_players.end();
+    return m_current_players.contains(player);
+}
+
+Bitboard KingSafety::allowed_destinations(int index) const {
+    if (!pinned.test(index))
+        return check_mask;
+    for (int i = 0; i < pin_count; ++i) {
+        if (pins[i].first == index)
+            return check_mask & pins[i].second;
+    }
+    __builtin_unreachable();
 }
 
-std::vector<Point> GameState::filter_moves(const Point origin, std::vector<Point>& valid_moves, const Color player, bool enforce_king_protection) const {
-    if (!enforce_king_protection)
-        return valid_moves;
-    auto piece_attacking_king = square_is_under_attack_for_player(m_king_positions[static_cast<int>(player)], player);
-    if (piece_attacking_king.first) {
-        std::vector<Point> king_protection_moves;
-        for (const auto& move : valid_moves) {
-            GameState test_board {*this};
-            test_board.unsafe_move_piece_to(origin, move);
-            if (!test_board.square_is_under_attack_for_player(test_board.m_king_positions[static_cast<int>(player)], player).first)
-                king_protection_moves.push_back(move);
+KingSafety GameState::get_king_safety(Color player) const {
+    KingSafety safety {};
+    const auto king = m_piece_bitboards[static_cast<int>(Piece::King)] & m_color_bitboards[static_cast<int>(player)];
+    if (king.none()) {
+        // Nothing to protect.
+        safety.check_mask = s_board_tables.playable;
+        return safety;
+    }
+
+    const int king_index = king.lsb();
+    const auto enemies = enemies_of(player);
+    const auto& own_pieces = m_color_bitboards[static_cast<int>(player)];
+    const auto& queens = m_piece_bitboards[static_cast<int>(Piece::Queen)];
+    const auto rooks_and_queens = (m_piece_bitboards[static_cast<int>(Piece::Rook)] | queens) & enemies;
+    const auto bishops_and_queens = (m_piece_bitboards[static_cast<int>(Piece::Bishop)] | queens) & enemies;
+
+    if (is_attacked(king_index, player))
+        safety.checkers = attackers_of(king_index, m_occupied) & enemies;
+    if (safety.checkers.none())
+        safety.check_mask = s_board_tables.playable;
+    else if (safety.checkers.count() == 1)
+        safety.check_mask = safety.checkers;
+
+    for (int direction = 0; direction < 8; ++direction) {
+        const auto& ray = s_board_tables.rays[direction][king_index];
+        auto blockers = ray & m_occupied;
+        if (blockers.none())
+            continue;
+        const bool ascending = direction_is_ascending(s_directions[direction]);
+        const int first = ascending ? blockers.lsb() : blockers.msb();
+        const auto& sliders = direction < 4 ? rooks_and_queens : bishops_and_queens;
+        // Everything between the king and 'index', including 'index' itself.
+        auto line_to = [&](int index) { return ray & ~s_board_tables.rays[direction][index]; };
+
+        if (sliders.test(first)) {
+            if (safety.checkers.count() == 1)
+                safety.check_mask = line_to(first);
+            continue;
+        }
+        if (!own_pieces.test(first))
+            continue;
+        blockers.reset(first);
+        if (blockers.none())
+            continue;
+        const int second = ascending ? blockers.lsb() : blockers.msb();
+        if (sliders.test(second)) {
+            safety.pinned.set(first);
+            safety.pins[safety.pin_count++] = {first, line_to(second)};
         }
-        return king_protection_moves;
     }
+    return safety;
+}
 
-    auto move_makes_king_vulnerable = [&](const Point& move) -> bool {
-        GameState test_board {*this};
-        test_board.unsafe_move_piece_to(origin, move);
-        return test_board.square_is_under_attack_for_player(test_board.m_king_positions[static_cast<int>(player)], player).first;
+void GameState::remove_illegal_moves(const KingSafety& safety, const Point origin, MoveList& valid_moves, int first, const Color player) const {
+    const auto allowed = safety.allowed_destinations(square_index(origin));
+    // En passant removes a piece that is not on the destination square, which the pin and check data cannot account for,
+    // so such moves are checked by looking for attackers of the king on the board as it would be after the capture.
+    auto move_makes_king_vulnerable = [&](const Move& move) -> bool {
+        if (!move.has_flag(Move::EnPassant))
+            return !allowed.test(move.destination_index());
+        const auto king = m_piece_bitboards[static_cast<int>(Piece::King)] & m_color_bitboards[static_cast<int>(player)];
+        if (king.none())
+            return false;
+        const auto destination = move.destination();
+        const auto captured = player == Color::Blue || player == Color::Green ? Point {origin.x, destination.y} : Point {destination.x, origin.y};
+        auto occupied = m_occupied;
+        occupied.reset(square_index(origin));
+        occupied.reset(square_index(captured));
+        occupied.set(move.destination_index());
+        auto attackers = attackers_of(king.lsb(), occupied) & enemies_of(player);
+        attackers.reset(square_index(captured));
+        return attackers.any();
     };
 
-    valid_moves.erase(std::remove_if(valid_moves.begin(), valid_moves.end(), move_makes_king_vulnerable), valid_moves.end());
-    return valid_moves;
+    int kept = first;
+    for (int i = first; i < valid_moves.size(); ++i) {
+        if (!move_makes_king_vulnerable(valid_moves[i]))
+            valid_moves[kept++] = valid_moves[i];
+    }
+    valid_moves.resize(kept);
 }
 
-std::vector<Point> GameState::get_valid_moves_for_position(Point position, Color player, bool enforce_king_protection) const {
-    if (!m_board[position.x][position.y].piece.has_value())
-        return {};
-    switch (m_board[position.x][position.y].piece.value()) {
+std::vector<Point> GameState::filter_moves(const Point origin, MoveList& valid_moves, const Color player, bool enforce_king_protection) const {
+    if (enforce_king_protection)
+        remove_illegal_moves(get_king_safety(player), origin, valid_moves, 0, player);
+
+    std::vector<Point> destinations {};
+    destinations.reserve(valid_moves.size());
+    for (const auto& move : valid_moves) {
+        // Promotions show up once per piece; the destination only needs to be listed once.
+        if (!move.promotion().has_value() || move.promotion() == Piece::Queen)
+            destinations.push_back(move.destination());
+    }
+    return destinations;
+}
+
+void GameState::add_pseudo_legal_moves(Point position, Color player, MoveList& valid_moves) const {
+    add_pseudo_legal_moves(position, m_board[position.x][position.y].piece().value(), player, valid_moves);
+}
+
+void GameState::add_pseudo_legal_moves(Point position, Piece piece, Color player, MoveList& valid_moves) const {
+    with_color_traits(player, [&](auto traits) { add_pseudo_legal_moves<decltype(traits)::color>(position, piece, valid_moves); });
+}
+
+template<Color C>
+void GameState::add_pseudo_legal_moves(Point position, Piece piece, MoveList& valid_moves) const {
+    constexpr Color player = C;
+    switch (piece) {
         case Piece::Rook:
-            return get_valid_moves_for_rook(position, player, enforce_king_protection);
+            add_moves_for_rook(position, player, valid_moves);
+            break;
         case Piece::Bishop:
-            return get_valid_moves_for_bishop(position, player, enforce_king_protection);
+            add_moves_for_bishop(position, player, valid_moves);
+            break;
         case Piece::King:
-            return get_valid_moves_for_king(position, player);
+            add_moves_for_king<C>(position, valid_moves);
+            break;
         case Piece::Queen:
-            return get_valid_moves_for_queen(position, player, enforce_king_protection);
+            add_moves_for_queen(position, player, valid_moves);
+            break;
         case Piece::Knight:
-            return get_valid_moves_for_knight(position, player, enforce_king_protection);
+            add_moves_for_knight(position, player, valid_moves);
+            break;
         case Piece::Pawn:
-            return get_valid_moves_for_pawn(position, player, enforce_king_protection);
+            add_moves_for_pawn<C>(square_index(position), valid_moves);
+            break;
         default:
             __builtin_unreachable();
     }
 }
 
-std::vector<Point> GameState::get_valid_moves_for_rook(const Point position, const Color player, bool enforce_king_protection) const {
-    std::vector<Point> valid_moves {};
+void GameState::get_valid_moves_for_position(Point position, Color player, bool enforce_king_protection, MoveList& valid_moves) const {
+    if (!m_board[position.x][position.y].piece().has_value())
+        return;
+    const int first = valid_moves.size();
+    add_pseudo_legal_moves(position, player, valid_moves);
+    // King moves are always checked for safety.
+    if (enforce_king_protection && m_board[position.x][position.y].piece() != Piece::King)
+        remove_illegal_moves(get_king_safety(player), position, valid_moves, first, player);
+}
+
+void GameState::generate_legal_moves(Color player, MoveList& legal_moves) const {
+    with_color_traits(player, [&](auto traits) { generate_legal_moves<decltype(traits)::color>(legal_moves); });
+}
+
+template<Color C>
+void GameState::generate_legal_moves(MoveList& legal_moves) const {
+    constexpr Color player = C;
+    const auto safety = get_king_safety(player);
+    for (const auto& [piece, index] : m_piece_lists[static_cast<int>(player)]) {
+        // In double check, only the king may move.
+        if (safety.check_mask.none() && piece != Piece::King)
+            continue;
+        const auto position = point_from_index(index);
+        const int first = legal_moves.size();
+        add_pseudo_legal_moves<C>(position, piece, legal_moves);
+        if (piece != Piece::King)
+            remove_illegal_moves(safety, position, legal_moves, first, player);
+    }
+}
 
-    iterate_from(valid_moves, player, position, {1, 0});
-    iterate_from(valid_moves, player, position, {-1, 0});
-    iterate_from(valid_moves, player, position, {0, 1});
-    iterate_from(valid_moves, player, position, {0, -1});
+// A cheap test which finds a legal move in most positions, but not all. Expects the player not to be in check, so that a king
+// step onto a square nobody attacks is legal, as is any move of a piece that is not on a line through the king and thus cannot be pinned.
+bool GameState::has_obviously_legal_move(Color player) const {
+    const auto& own_pieces = m_color_bitboards[static_cast<int>(player)];
+    const int king_index = square_index(m_king_positions[static_cast<int>(player)]);
+    for (auto steps = s_board_tables.king_attacks[king_index] & ~own_pieces; steps.any();) {
+        if (!is_attacked(steps.pop_lsb(), player))
+            return true;
+    }
 
+    Bitboard lines_through_king {};
+    for (const auto& rays : s_board_tables.rays)
+        lines_through_king |= rays[king_index];
+    for (const auto& [piece, index] : m_piece_lists[static_cast<int>(player)]) {
+        if (piece == Piece::King || lines_through_king.test(index))
+            continue;
+        if (piece != Piece::Pawn) {
+            if ((attacks_from(index, piece, player, m_occupied) & ~own_pieces).any())
+                return true;
+            continue;
+        }
+        // Leaving out en passant, which may uncover a line through the king by removing the captured pawn.
+        const auto ahead = s_square_lists.pawn_pushes[static_cast<int>(player)][index];
+        if ((ahead != s_no_square && !m_occupied.test(ahead)) || (attacks_from(index, piece, player, m_occupied) & m_occupied & ~own_pieces).any())
+            return true;
+    }
+    return false;
+}
+
+bool GameState::has_legal_move(Color player) const {
+    return with_color_traits(player, [&](auto traits) { return has_legal_move<decltype(traits)::color>(); });
+}
+
+template<Color C>
+bool GameState::has_legal_move() const {
+    constexpr Color player = C;
+    const auto safety = get_king_safety(player);
+    MoveList valid_moves;
+    for (const auto& [piece, index] : m_piece_lists[static_cast<int>(player)]) {
+        if (safety.check_mask.none() && piece != Piece::King)
+            continue;
+        const auto position = point_from_index(index);
+        valid_moves.clear();
+        add_pseudo_legal_moves<C>(position, piece, valid_moves);
+        if (piece != Piece::King)
+            remove_illegal_moves(safety, position, valid_moves, 0, player);
+        if (!valid_moves.empty())
+            return true;
+    }
+    return false;
+}
+
+std::vector<Point> GameState::get_valid_moves_for_position(Point position, Color player, bool enforce_king_protection) const {
+    MoveList valid_moves;
+    get_valid_moves_for_position(position, player, enforce_king_protection, valid_moves);
+    return filter_moves(position, valid_moves, player, false);
+}
+
+std::vector<Point> GameState::get_valid_moves_for_rook(const Point position, const Color player, bool enforce_king_protection) const {
+    MoveList valid_moves;
+    add_moves_for_rook(position, player, valid_moves);
     return filter_moves(position, valid_moves, player, enforce_king_protection);
 }
 
-std::vector<Point> GameState::get_valid_moves_for_bishop(Point position, Color player, bool enforce_king_protection) const {
-    std::vector<Point> valid_moves {};
-    iterate_from(valid_moves, player, position, {1, 1});
-    iterate_from(valid_moves, player, position, {-1, -1});
-    iterate_from(valid_moves, player, position, {-1, 1});
-    iterate_from(valid_moves, player, position, {1, -1});
+void GameState::add_moves_for_rook(const Point position, const Color player, MoveList& valid_moves) const {
+    for (int direction = 0; direction < 4; ++direction)
+        iterate_from(valid_moves, player, position, direction);
+}
 
+std::vector<Point> GameState::get_valid_moves_for_bishop(Point position, Color player, bool enforce_king_protection) const {
+    MoveList valid_moves;
+    add_moves_for_bishop(position, player, valid_moves);
     return filter_moves(position, valid_moves, player, enforce_king_protection);
 }
 
-std::pair<bool, Point> GameState::square_is_under_attack_for_player(Point position, Color player) const {
-    std::array<std::array<std::pair<bool, Point>, 14>, 14> attack_board;
-    auto iterate_position_if_valid = [this, &attack_board, player, position](Point iterate_position) {
-        if (!is_valid_position(iterate_position))
-            return;
-        if (!m_board[iterate_position.x][iterate_position.y].color.has_value() || !m_board[iterate_position.x][iterate_position.y].piece.has_value())
-            return;
-        if (m_board[iterate_position.x][iterate_position.y].color.value() == player)
-            return;
-        if (!player_exists(m_board[iterate_position.x][iterate_position.y].color.value()))
-            return;
-        // We cannot recurse this function, so we use an alternative path to find quasi-valid moves for enemy kings, which is good enough for our purposes.
-        auto moves = get_valid_moves_for_king_lite(iterate_position, m_board[iterate_position.x][iterate_position.y].color.value());
-        if (m_board[iterate_position.x][iterate_position.y].piece.value() != Piece::King)
-            moves = get_valid_moves_for_position(iterate_position, m_board[iterate_position.x][iterate_position.y].color.value(), false);
-        for (const auto& move : moves) {
-            if (move == position) {
-                attack_board[move.x][move.y].first = true;
-                attack_board[move.x][move.y].second = {iterate_position.x, iterate_position.y};
-            }
-        }
-    };
-    for (int x = 3; x < 11; ++x) {
-        for (int y = 0; y < 3; ++y)
-            iterate_position_if_valid({x, y});
+void GameState::add_moves_for_bishop(Point position, Color player, MoveList& valid_moves) const {
+    for (int direction = 4; direction < 8; ++direction)
+        iterate_from(valid_moves, player, position, direction);
+}
+
+// Pieces of any color that attack the given square, with sliders blocked by 'occupied'.
+Bitboard GameState::attackers_of(int index, const Bitboard& occupied) const {
+    const auto& knights = m_piece_bitboards[static_cast<int>(Piece::Knight)];
+    const auto& kings = m_piece_bitboards[static_cast<int>(Piece::King)];
+    const auto& queens = m_piece_bitboards[static_cast<int>(Piece::Queen)];
+    const auto rooks_and_queens = m_piece_bitboards[static_cast<int>(Piece::Rook)] | queens;
+    const auto bishops_and_queens = m_piece_bitboards[static_cast<int>(Piece::Bishop)] | queens;
+    const auto& pawns = m_piece_bitboards[static_cast<int>(Piece::Pawn)];
+
+    Bitboard attackers = (s_board_tables.knight_attacks[index] & knights) | (s_board_tables.king_attacks[index] & kings);
+    for (int color = 0; color < 4; ++color)
+        attackers |= s_board_tables.pawn_attackers[color][index] & pawns & m_color_bitboards[color];
+
+    for (int direction = 0; direction < 8; ++direction) {
+        const auto blockers = s_board_tables.rays[direction][index] & occupied;
+        if (blockers.none())
+            continue;
+        const int blocker = direction_is_ascending(s_directions[direction]) ? blockers.lsb() : blockers.msb();
+        if ((direction < 4 ? rooks_and_queens : bishops_and_queens).test(blocker))
+            attackers.set(blocker);
     }
+    return attackers;
+}
 
-    for (int x = 3; x < 11; ++x) {
-        for (int y = 11; y < 14; ++y)
-            iterate_position_if_valid({x, y});
+// Pieces that may attack 'player': those of every other player that is still in the game.
+Bitboard GameState::enemies_of(Color player) const {
+    Bitboard enemies {};
+    for (const auto& enemy : m_current_players) {
+        if (enemy != player)
+            enemies |= m_color_bitboards[static_cast<int>(enemy)];
     }
+    return enemies;
+}
 
-    for (int x = 0; x < 14; ++x) {
-        for (int y = 3; y < 11; ++y)
-            iterate_position_if_valid({x, y});
+bool GameState::is_attacked(int index, Color player) const {
+    for (const auto& enemy : m_current_players) {
+        if (enemy != player && m_attack_counts[static_cast<int>(enemy)][index])
+            return true;
     }
-    return attack_board[position.x][position.y];
+    return false;
 }
 
-// This function does not ensure that the king is not placed in check. It is for internal use only.
-std::vector<Point> GameState::get_valid_moves_for_king_lite(Point position, Color player) const {
-    std::vector<Point> valid_moves {};
-    for (int row = position.x - 1; row < position.x + 2; ++row) {
-        for (int column = position.y - 1; column < position.y + 2; ++column) {
-            Point current_position {row, column};
-            if (is_valid_position(current_position) && (current_position != position) && !point_is_of_color(current_position, player))
-                valid_moves.push_back(current_position);
-        }
+std::pair<bool, Point> GameState::square_is_under_attack_for_player(Point position, Color player) const {
+    if (!is_attacked(square_index(position), player))
+        return {false, {}};
+    const auto attackers = attackers_of(square_index(position), m_occupied) & enemies_of(player);
+    if (attackers.none())
+        return {false, {}};
+    return {true, point_from_index(attackers.lsb())};
+}
+
+int GameState::static_exchange(Point target, Move first) const {
+    const int index = square_index(target);
+    const auto origin = first.origin();
+    const auto& moved = m_board[origin.x][origin.y];
+    const auto player = moved.color().value();
+    auto occupied = m_occupied;
+    occupied.reset(first.origin_index());
+    auto victim = m_board[target.x][target.y];
+    if (first.has_flag(Move::EnPassant)) {
+        const auto captured = player == Color::Blue || player == Color::Green ? Point {origin.x, target.y} : Point {target.x, origin.y};
+        victim = m_board[captured.x][captured.y];
+        occupied.reset(square_index(captured));
+    }
+    // Pieces of eliminated players count for nobody.
+    int gain = victim.piece().has_value() && m_current_players.contains(victim.color().value()) ? s_exchange_values[static_cast<int>(victim.piece().value())] : 0;
+    int value = s_exchange_values[static_cast<int>(moved.piece().value())];
+    if (first.promotion().has_value()) {
+        gain += s_exchange_values[static_cast<int>(first.promotion().value())] - value;
+        value = s_exchange_values[static_cast<int>(first.promotion().value())];
     }
-    return valid_moves;
+    return gain + exchange_outcome(index, occupied, player, value, 0)[static_cast<int>(player)];
 }
 
-std::vector<Point> GameState::get_valid_moves_for_king(Point position, Color player) const {
-    std::vector<Point> valid_moves {};
-    for (const auto& move : get_valid_moves_for_king_lite(position, player)) {
-        GameState test_board {*this};
-        test_board.m_board[move.x][move.y].piece = Piece::King;
-        test_board.m_board[move.x][move.y].color = player;
-        test_board.m_board[move.x][move.y].has_moved = true;
-        test_board.empty_square(position);
-        if (!test_board.square_is_under_attack_for_player(move, player).first)
-            valid_moves.push_back(move);
-    }
-
-    auto push_back_castling_move_if_valid = [&](Point queenside_rook, Point kingside_rook, Point axis_map) {
-        bool kingside_path_blocked = false;
-        bool queenside_path_blocked = false;
-        if (!m_board[queenside_rook.x][queenside_rook.y].has_moved) {
-            int target = position.x;
-            if (axis_map.y != 0)
-                target = position.y;
-            for (int i = 4; i < target; ++i) {
-                auto piece = m_board[i][queenside_rook.y].piece;
-                if (axis_map.y != 0)
-                    piece = m_board[queenside_rook.x][i].piece;
-                if (piece.has_value()) {
-                    queenside_path_blocked = true;
-                    break;
-                }
+// What every player gains from the captures on square 'index' once 'owner' has moved a piece worth 'value' there. The other
+// players get to take it in turn order, each with their least valuable piece, and the first one for whom that pays off,
+// counting the captures that follow, does. Attackers are found again after every capture, so that pieces lined up behind
+// one another join in.
+std::array<int, 4> GameState::exchange_outcome(int index, const Bitboard& occupied, Color owner, int value, int depth) const {
+    // Exchanges hardly ever go this far, and the cost grows with every player who may take part.
+    constexpr int max_depth = 8;
+    if (depth == max_depth)
+        return {};
+    const auto attackers = attackers_of(index, occupied) & occupied;
+    for (int step = 1; step < 4; ++step) {
+        const auto capturer = static_cast<Color>((static_cast<int>(owner) + step) % 4);
+        const auto own_attackers = attackers & m_color_bitboards[static_cast<int>(capturer)];
+        if (!m_current_players.contains(capturer) || own_attackers.none())
+            continue;
+
+        int attacker = -1;
+        for (const auto piece : {Piece::Pawn, Piece::Knight, Piece::Bishop, Piece::Rook, Piece::Queen, Piece::King}) {
+            const auto candidates = own_attackers & m_piece_bitboards[static_cast<int>(piece)];
+            if (candidates.any()) {
+                attacker = candidates.lsb();
+                break;
             }
         }
-        if (!m_board[kingside_rook.x][kingside_rook.y].has_moved) {
-            int target = position.x;
-            if (axis_map.y != 0)
-                target = position.y;
-            for (int i = target + 1; i < 10; ++i) {
-                auto piece = m_board[i][kingside_rook.y].piece;
-                if (axis_map.y != 0)
-                    piece = m_board[kingside_rook.x][i].piece;
-                if (piece.has_value()) {
-                    kingside_path_blocked = true;
-                    break;
-                }
-            }
+        const auto piece = m_board[attacker / 14][attacker % 14].piece().value();
+        int gain = value;
+        int new_value = s_exchange_values[static_cast<int>(piece)];
+        if (piece == Piece::Pawn && is_promotion_square(point_from_index(index), capturer)) {
+            gain += s_exchange_values[static_cast<int>(Piece::Queen)] - new_value;
+            new_value = s_exchange_values[static_cast<int>(Piece::Queen)];
         }
-        if (!queenside_path_blocked) {
-            Point move = {position.x + axis_map.x, position.y + axis_map.y};
-            GameState test_board {*this};
-            test_board.unsafe_move_piece_to(position, move);
-            test_board.complete_castling_if_needed(position, move);
-            if (!test_board.square_is_under_attack_for_player(move, player).first)
-                valid_moves.push_back(move);
-        }
-        if (!kingside_path_blocked) {
-            Point move = {position.x - axis_map.x, position.y - axis_map.y};
-            GameState test_board {*this};
-            test_board.unsafe_move_piece_to(position, move);
-            test_board.complete_castling_if_needed(position, move);
-            if (!test_board.square_is_under_attack_for_player(move, player).first)
-                valid_moves.push_back(move);
+        auto remaining = occupied;
+        remaining.reset(attacker);
+        auto outcome = exchange_outcome(index, remaining, capturer, new_value, depth + 1);
+        outcome[static_cast<int>(capturer)] += gain;
+        if (outcome[static_cast<int>(capturer)] > 0) {
+            outcome[static_cast<int>(owner)] -= value;
+            return outcome;
         }
+    }
+    return {};
+}
+
+std::vector<Point> GameState::get_valid_moves_for_king(Point position, Color player) const {
+    MoveList valid_moves;
+    add_moves_for_king(position, player, valid_moves);
+    return filter_moves(position, valid_moves, player, false);
+}
+
+void GameState::add_moves_for_king(Point position, Color player, MoveList& valid_moves) const {
+    with_color_traits(player, [&](auto traits) { add_moves_for_king<decltype(traits)::color>(position, valid_moves); });
+}
+
+template<Color C>
+void GameState::add_moves_for_king(Point position, MoveList& valid_moves) const {
+    using Traits = ColorTraits<C>;
+    constexpr Color player = C;
+    const int king_index = square_index(position);
+    // The attack maps treat the king as a blocker, so squares behind it on a checking slider's line are not marked as attacked.
+    Bitboard shadowed_squares {};
+    if (is_attacked(king_index, player)) {
+        const auto& queens = m_piece_bitboards[static_cast<int>(Piece::Queen)];
+        const auto enemies = enemies_of(player);
+        const auto rooks_and_queens = (m_piece_bitboards[static_cast<int>(Piece::Rook)] | queens) & enemies;
+        const auto bishops_and_queens = (m_piece_bitboards[static_cast<int>(Piece::Bishop)] | queens) & enemies;
+        for (int direction = 0; direction < 8; ++direction) {
+            const auto blockers = s_board_tables.rays[direction][king_index] & m_occupied;
+            if (blockers.none())
+                continue;
+            const int first = direction_is_ascending(s_directions[direction]) ? blockers.lsb() : blockers.msb();
+            // The opposite direction is always the other one of its pair.
+            const auto behind = s_square_lists.rays[direction ^ 1][king_index][0];
+            if ((direction < 4 ? rooks_and_queens : bishops_and_queens).test(first) && behind != s_no_square)
+                shadowed_squares.set(behind);
+        }
+    }
+    auto square_is_safe = [&](const Point& square) {
+        return !is_attacked(square_index(square), player) && !shadowed_squares.test(square_index(square));
     };
 
+    const auto targets = s_board_tables.king_attacks[king_index] & ~m_color_bitboards[static_cast<int>(player)];
+    targets.for_each([&](int target) {
+        if (square_is_safe(point_from_index(target)))
+            valid_moves.push_back({king_index, target, m_occupied.test(target) ? Move::Capture : 0});
+    });
+
     // Castling
-    if (!m_board[position.x][position.y].has_moved && !square_is_under_attack_for_player(position, player).first) {
-        switch (player) {
-            case Color::Red:
-                push_back_castling_move_if_valid({3, 13}, {10, 13}, {-2, 0});
-                break;
-            case Color::Blue:
-                push_back_castling_move_if_valid({0, 10}, {0, 3}, {0, -2});
-                break;
-            case Color::Yellow:
-                push_back_castling_move_if_valid({3, 0}, {10, 0}, {-2, 0});
-                break;
-            case Color::Green:
-                push_back_castling_move_if_valid({13, 10}, {13, 3}, {0, -2});
-                break;
+    if (m_board[position.x][position.y].has_moved() || position != Traits::king_origin || !square_is_safe(position))
+        return;
+    for (const auto& option : Traits::castling_options) {
+        const auto& rook = m_board[option.rook_origin.x][option.rook_origin.y];
+        if (rook.piece() != Piece::Rook || rook.color() != player || rook.has_moved())
+            continue;
+
+        const Point step {(option.rook_origin.x > position.x) - (option.rook_origin.x < position.x), (option.rook_origin.y > position.y) - (option.rook_origin.y < position.y)};
+        bool path_is_clear = true;
+        for (Point square {position.x + step.x, position.y + step.y}; square != option.rook_origin; square = {square.x + step.x, square.y + step.y}) {
+            if (m_occupied.test(square_index(square)))
+                path_is_clear = false;
         }
+        // The king may not pass through or land on an attacked square.
+        if (path_is_clear && square_is_safe({position.x + step.x, position.y + step.y}) && square_is_safe(option.king_destination))
+            valid_moves.push_back({king_index, square_index(option.king_destination), Move::Castling});
     }
-    return valid_moves;
 }
 
 std::vector<Point> GameState::get_valid_moves_for_queen(Point position, Color player, bool enforce_king_protection) const {
-    std::vector<Point> valid_moves {};
-
-    // Horizontal & vertical moves.
-    iterate_from(valid_moves, player, position, {1, 0});
-    iterate_from(valid_moves, player, position, {-1, 0});
-    iterate_from(valid_moves, player, position, {0, 1});
-    iterate_from(valid_moves, player, position, {0, -1});
-
-    // Diagonal moves.
-    iterate_from(valid_moves, player, position, {1, 1});
-    iterate_from(valid_moves, player, position, {-1, -1});
-    iterate_from(valid_moves, player, position, {-1, 1});
-    iterate_from(valid_moves, player, position, {1, -1});
-
+    MoveList valid_moves;
+    add_moves_for_queen(position, player, valid_moves);
     return filter_moves(position, valid_moves, player, enforce_king_protection);
 }
 
-std::vector<Point> GameState::get_valid_moves_for_knight(Point position, Color player, bool enforce_king_protection) const {
-    std::vector<Point> valid_moves {};
-    auto push_back_if_valid = [&](const Point& position) {
-        if (is_valid_position(position) && !point_is_of_color(position, player))
-            valid_moves.push_back(position);
-    };
+void GameState::add_moves_for_queen(Point position, Color player, MoveList& valid_moves) const {
+    // Horizontal & vertical moves, then diagonal moves.
+    for (int direction = 0; direction < 8; ++direction)
+        iterate_from(valid_moves, player, position, direction);
+}
 
-    push_back_if_valid({position.x - 2, position.y - 1});
-    push_back_if_valid({position.x - 1, position.y - 2});
-    push_back_if_valid({position.x + 1, position.y - 2});
-    push_back_if_valid({position.x + 2, position.y - 1});
+std::vector<Point> GameState::get_valid_moves_for_knight(Point position, Color player, bool enforce_king_protection) const {
+    MoveList valid_moves;
+    add_moves_for_knight(position, player, valid_moves);
+    return filter_moves(position, valid_moves, player, enforce_king_protection);
+}
 
-    push_back_if_valid({position.x - 2, position.y + 1});
-    push_back_if_valid({position.x - 1, position.y + 2});
-    push_back_if_valid({position.x + 1, position.y + 2});
-    push_back_if_valid({position.x + 2, position.y + 1});
+void GameState::add_moves_for_knight(Point position, Color player, MoveList& valid_moves) const {
+    const int origin = square_index(position);
+    const auto& own_pieces = m_color_bitboards[static_cast<int>(player)];
+    for (const auto* target = s_square_lists.knight_targets[origin].data(); *target != s_no_square; ++target) {
+        if (!own_pieces.test(*target))
+            valid_moves.push_back({origin, *target, m_occupied.test(*target) ? Move::Capture : 0});
+    }
+}
 
+std::vector<Point> GameState::get_valid_moves_for_pawn(Point position, Color player, bool enforce_king_protection) const {
+    MoveList valid_moves;
+    add_moves_for_pawn(position, player, valid_moves);
     return filter_moves(position, valid_moves, player, enforce_king_protection);
 }
 
-std::vector<Point> GameState::get_valid_moves_for_pawn(Point position, Color player, bool enforce_king_protection) const {
-    std::vector<Point> valid_moves {};
-    Point direction {};
-    Axis capture_axis = Axis::X;
-    bool may_double_jump = false;
-    switch (player) {
-        case Color::Red:
-            direction = {0, -1};
-            if (position.y == 12)
-                may_double_jump = true;
-            break;
-        case Color::Blue:
-            direction = {1, 0};
-            capture_axis = Axis::Y;
-            if (position.x == 1)
-                may_double_jump = true;
-            break;
-        case Color::Yellow:
-            direction = {0, 1};
-            if (position.y == 1)
-                may_double_jump = true;
-            break;
-        case Color::Green:
-            direction = {-1, 0};
-            capture_axis = Axis::Y;
-            if (position.x == 12)
-                may_double_jump = true;
-    }
+void GameState::add_moves_for_pawn(Point position, Color player, MoveList& valid_moves) const {
+    with_color_traits(player, [&](auto traits) { add_moves_for_pawn<decltype(traits)::color>(square_index(position), valid_moves); });
+}
 
-    auto push_back_if_valid = [&](Point offset) -> bool {
-        if (is_valid_position({position.x + offset.x, position.y + offset.y}) && !m_board[position.x + offset.x][position.y + offset.y].piece.has_value()) {
-            valid_moves.push_back({position.x + offset.x, position.y + offset.y});
-            return true;
+template<Color C>
+void GameState::add_moves_for_pawn(int origin, MoveList& valid_moves) const {
+    using Traits = ColorTraits<C>;
+    auto push_back_move = [&](int destination, int flags) {
+        if (Traits::rank_of(destination) != Traits::promotion_rank) {
+            valid_moves.push_back({origin, destination, flags});
+            return;
         }
-        return false;
+        for (int piece = 0; piece < 4; ++piece)
+            valid_moves.push_back({origin, destination, flags, static_cast<Piece>(piece)});
     };
 
-    if (push_back_if_valid(direction) && may_double_jump)
-        push_back_if_valid({direction.x * 2, direction.y * 2});
+    const auto ahead = s_square_lists.pawn_pushes[Traits::index][origin];
+    if (ahead != s_no_square && !m_occupied.test(ahead)) {
+        push_back_move(ahead, 0);
+        const auto beyond = s_square_lists.pawn_pushes[Traits::index][ahead];
+        if (Traits::rank_of(origin) == Traits::pawn_rank && beyond != s_no_square && !m_occupied.test(beyond))
+            push_back_move(beyond, Move::DoubleJump);
+    }
 
-    auto push_back_if_valid_capture = [&](Point offset) {
-        Point onward {position.x + direction.x + offset.x, position.y + direction.y + offset.y};
-        if (is_valid_position(onward) && m_board[onward.x][onward.y].piece.has_value() && !point_is_of_color(onward, player))
-            valid_moves.push_back(onward);
-        if (m_board[position.x + offset.x][position.y + offset.y].just_double_jumped)
-            valid_moves.push_back(onward);
-    };
+    for (const auto& [capture, side] : Traits::captures) {
+        const auto onward = s_square_lists.rays[capture][origin][0];
+        if (onward == s_no_square)
+            continue;
+        if (m_occupied.test(onward)) {
+            if (!m_color_bitboards[Traits::index].test(onward))
+                push_back_move(onward, Move::Capture);
+            continue;
+        }
+        const auto neighbour_index = s_square_lists.rays[side][origin][0];
+        if (neighbour_index == s_no_square)
+            continue;
+        // Only a pawn that skipped over the square the capture lands on may be taken, which rules out one that jumped across
+        // the capturer's path from the side.
+        const auto& neighbour = m_board[neighbour_index / 14][neighbour_index % 14];
+        if (!neighbour.just_double_jumped() || neighbour.piece() != Piece::Pawn || neighbour.color() == C)
+            continue;
+        const auto& jump = s_pawn_directions[static_cast<int>(neighbour.color().value())];
+        if (neighbour_index - (jump.x * 14 + jump.y) == onward)
+            push_back_move(onward, Move::Capture | Move::EnPassant);
+    }
+}
 
-    switch (capture_axis) {
-        case Axis::X:
-            push_back_if_valid_capture({1, 0});
-            push_back_if_valid_capture({-1, 0});
-            break;
-        case Axis::Y:
-            push_back_if_valid_capture({0, 1});
-            push_back_if_valid_capture({0, -1});
-            break;
+GameState* GameStatePool::acquire(const GameState& game) {
+    Slot* slot;
+    if (!m_free.empty()) {
+        slot = m_free.back();
+        m_free.pop_back();
+    } else {
+        if (m_used == block_size) {
+            // Left uninitialized, as every slot is overwritten when it is handed out.
+            m_blocks.emplace_back(new Slot[block_size]);
+            m_used = 0;
+        }
+        slot = &m_blocks.back()[m_used++];
     }
+    ++m_size;
+    return new (slot->bytes) GameState(game);
+}
 
-    return filter_moves(position, valid_moves, player, enforce_king_protection);
+GameState* GameStatePool::acquire() {
+    static const GameState initial_position;
+    return acquire(initial_position);
+}
+
+void GameStatePool::release(GameState* game) {
+    game->~GameState();
+    m_free.push_back(reinterpret_cast<Slot*>(game));
+    --m_size;
 }
 
 }
@@ -1,8 +1,15 @@
 #pragma once
 
+#include "bitboard.h"
+#include "nnue.h"
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -14,7 +21,7 @@ enum class Axis {
 };
 
 // In order of turns.
-enum class Color {
+enum class Color : std::uint8_t {
     Red,
     Blue,
     Yellow,
@@ -22,7 +29,7 @@ enum class Color {
 };
 
 // First four in order of promotion.
-enum class Piece {
+enum class Piece : std::uint8_t {
     Queen,
     Rook,
     Bishop,
@@ -36,41 +43,327 @@ enum class IterationDecision {
     Break,
 };
 
-struct Square {
-    std::optional<Piece> piece = std::nullopt;
-    std::optional<Color> color = std::nullopt;
-    bool just_double_jumped = false; // Used to validate whether performing an "en passant" move is legal.
-    bool has_moved = false;          // Used to validate whether castling is legal.
+// The contents of a square packed into a byte: the piece plus one in the lowest three bits and the color plus one in the
+// next three, with zero meaning none, then the two flags.
+class Square {
+public:
+    constexpr Square() = default;
+
+    constexpr Square(Piece piece, Color color)
+        : m_data(static_cast<std::uint8_t>((static_cast<int>(piece) + 1) | (static_cast<int>(color) + 1) << 3)) {
+    }
+
+    constexpr std::optional<Piece> piece() const {
+        if (!(m_data & 0x7))
+            return std::nullopt;
+        return static_cast<Piece>((m_data & 0x7) - 1);
+    }
+
+    constexpr std::optional<Color> color() const {
+        if (!(m_data & 0x38))
+            return std::nullopt;
+        return static_cast<Color>(((m_data >> 3) & 0x7) - 1);
+    }
+
+    constexpr bool just_double_jumped() const { return m_data & s_just_double_jumped; } // Used to validate whether performing an "en passant" move is legal.
+    constexpr bool has_moved() const { return m_data & s_has_moved; }                   // Used to validate whether castling is legal.
+
+    constexpr void set_piece(std::optional<Piece> piece) {
+        m_data = static_cast<std::uint8_t>((m_data & ~0x7) | (piece.has_value() ? static_cast<int>(piece.value()) + 1 : 0));
+    }
+
+    constexpr void set_color(std::optional<Color> color) {
+        m_data = static_cast<std::uint8_t>((m_data & ~0x38) | (color.has_value() ? static_cast<int>(color.value()) + 1 : 0) << 3);
+    }
+
+    constexpr void set_just_double_jumped(bool just_double_jumped) { set_flag(s_just_double_jumped, just_double_jumped); }
+    constexpr void set_has_moved(bool has_moved) { set_flag(s_has_moved, has_moved); }
+
+private:
+    static constexpr std::uint8_t s_just_double_jumped = 1 << 6;
+    static constexpr std::uint8_t s_has_moved = 1 << 7;
+
+    constexpr void set_flag(std::uint8_t flag, bool value) { m_data = static_cast<std::uint8_t>(value ? m_data | flag : m_data & ~flag); }
+
+    std::uint8_t m_data = 0;
+};
+
+// A set of players held as one bit per color, which goes through them in order of turns.
+class PlayerSet {
+public:
+    class Iterator {
+    public:
+        constexpr explicit Iterator(int mask)
+            : m_mask(mask) {
+        }
+
+        constexpr Color operator*() const { return static_cast<Color>(__builtin_ctz(m_mask)); }
+        constexpr Iterator& operator++() {
+            m_mask &= m_mask - 1;
+            return *this;
+        }
+        constexpr bool operator!=(const Iterator& rhs) const { return m_mask != rhs.m_mask; }
+
+    private:
+        int m_mask;
+    };
+
+    constexpr PlayerSet() = default;
+
+    constexpr explicit PlayerSet(int mask)
+        : m_mask(static_cast<std::uint8_t>(mask)) {
+    }
+
+    constexpr int mask() const { return m_mask; }
+    constexpr int size() const { return __builtin_popcount(m_mask); }
+    constexpr bool empty() const { return m_mask == 0; }
+    constexpr bool contains(Color player) const { return m_mask & (1 << static_cast<int>(player)); }
+    // Must not be called on an empty set.
+    constexpr Color front() const { return static_cast<Color>(__builtin_ctz(m_mask)); }
+    // The player whose turn comes after 'player', wrapping around. Must not be called on an empty set.
+    constexpr Color next_after(Color player) const {
+        const int later = m_mask & ~((2 << static_cast<int>(player)) - 1);
+        return static_cast<Color>(__builtin_ctz(later ? later : m_mask));
+    }
+
+    constexpr void insert(Color player) { m_mask |= 1 << static_cast<int>(player); }
+    constexpr void erase(Color player) { m_mask &= ~(1 << static_cast<int>(player)); }
+
+    constexpr Iterator begin() const { return Iterator(m_mask); }
+    constexpr Iterator end() const { return Iterator(0); }
+
+private:
+    std::uint8_t m_mask = 0;
 };
 
 struct Point {
     int x = 0;
     int y = 0;
 
-    bool operator==(const Point& rhs) const {
+    constexpr bool operator==(const Point& rhs) const {
         return x == rhs.x && y == rhs.y;
     }
 
-    bool operator!=(const Point& rhs) const {
+    constexpr bool operator!=(const Point& rhs) const {
         return !(*this == rhs);
     }
 };
 
+inline int square_index(const Point& position) {
+    return position.x * 14 + position.y;
+}
+
+inline Point point_from_index(int index) {
+    return {index / 14, index % 14};
+}
+
+// A move packed into 32 bits: the origin and destination square indices, the piece a pawn is promoted to, and flags describing the move.
+// Note that a default-constructed move is left uninitialized so that move lists are cheap to create; 'Move {}' is the null move.
+class Move {
+public:
+    enum Flag : std::uint8_t {
+        Capture = 1 << 0,
+        DoubleJump = 1 << 1,
+        EnPassant = 1 << 2,
+        Castling = 1 << 3,
+    };
+
+    Move() = default;
+
+    constexpr Move(int origin, int destination, int flags = 0, std::optional<Piece> promotion = std::nullopt)
+        : m_data(origin | destination << 8 | (promotion.has_value() ? static_cast<int>(promotion.value()) + 1 : 0) << 16 | flags << 19) {
+    }
+
+    constexpr int origin_index() const { return m_data & 0xff; }
+    constexpr int destination_index() const { return (m_data >> 8) & 0xff; }
+    Point origin() const { return point_from_index(origin_index()); }
+    Point destination() const { return point_from_index(destination_index()); }
+
+    constexpr std::optional<Piece> promotion() const {
+        if (!((m_data >> 16) & 0x7))
+            return std::nullopt;
+        return static_cast<Piece>(((m_data >> 16) & 0x7) - 1);
+    }
+
+    constexpr bool has_flag(Flag flag) const { return (m_data >> 19) & flag; }
+    constexpr bool is_null() const { return m_data == 0; }
+    constexpr std::uint32_t raw() const { return m_data; }
+
+    static constexpr Move from_raw(std::uint32_t data) {
+        Move move {};
+        move.m_data = data;
+        return move;
+    }
+
+    constexpr bool operator==(const Move& rhs) const { return m_data == rhs.m_data; }
+    constexpr bool operator!=(const Move& rhs) const { return m_data != rhs.m_data; }
+
+private:
+    std::uint32_t m_data;
+};
+
+// A fixed-capacity list of moves which lives on the stack, so generating moves does not allocate.
+class MoveList {
+public:
+    // No single side can come close to this many moves on this board, even with every pawn promoted.
+    static constexpr int capacity = 1024;
+
+    // Deliberately user-provided, so that value-initializing a list does not zero the whole array.
+    MoveList() { }
+
+    void push_back(const Move& move) { m_moves[m_size++] = move; }
+    void resize(int size) { m_size = size; }
+    void clear() { m_size = 0; }
+    int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const Move& operator[](int index) const { return m_moves[index]; }
+    Move& operator[](int index) { return m_moves[index]; }
+    const Move* begin() const { return m_moves.data(); }
+    const Move* end() const { return m_moves.data() + m_size; }
+    Move* begin() { return m_moves.data(); }
+    Move* end() { return m_moves.data() + m_size; }
+
+private:
+    std::array<Move, capacity> m_moves;
+    int m_size = 0;
+};
+
+// The pieces of one color and the squares they stand on, in no particular order. Kept up to date by 'GameState', so that
+// going through a player's pieces costs as much as there are pieces, rather than as much as there are squares.
+class PieceList {
+public:
+    struct Entry {
+        Piece piece;
+        std::uint8_t index; // Square index.
+    };
+
+    // A player never has more pieces than they start with, as promotion only replaces a pawn.
+    static constexpr int capacity = 16;
+
+    int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    int count(Piece piece) const { return m_counts[static_cast<int>(piece)]; }
+    const Entry& operator[](int index) const { return m_entries[index]; }
+    const Entry* begin() const { return m_entries.data(); }
+    const Entry* end() const { return m_entries.data() + m_size; }
+
+private:
+    friend class GameState;
+
+    std::array<Entry, capacity> m_entries {};
+    std::array<std::uint8_t, 6> m_counts {};
+    std::uint8_t m_size = 0;
+};
+
+// The material, piece-square and king safety terms of every color's position, in centipawns and indexed by color. Kept up
+// to date by 'GameState' as pieces come and go, so that evaluating a position takes the same time whatever is on the board.
+// Each term holds the four colors side by side, so that they are combined with a few vector instructions.
+class Evaluator {
+public:
+    const std::array<int, 4>& get_material() const { return m_material; }
+    const std::array<int, 4>& get_piece_square() const { return m_piece_square; }
+    // A bonus for every pawn next to the king.
+    const std::array<int, 4>& get_king_safety() const { return m_king_safety; }
+
+    std::array<int, 4> get_totals() const {
+        std::array<int, 4> totals;
+        for (int i = 0; i < 4; ++i)
+            totals[i] = m_material[i] + m_piece_square[i] + m_king_safety[i];
+        return totals;
+    }
+
+    bool operator==(const Evaluator& rhs) const {
+        return m_material == rhs.m_material && m_piece_square == rhs.m_piece_square && m_king_safety == rhs.m_king_safety;
+    }
+    bool operator!=(const Evaluator& rhs) const { return !(*this == rhs); }
+
+private:
+    friend class GameState;
+
+    std::array<int, 4> m_material {};
+    std::array<int, 4> m_piece_square {};
+    std::array<int, 4> m_king_safety {};
+};
+
+// Everything needed to take back a move played with 'GameState::make_move'.
+struct MoveUndo {
+    Point origin;
+    Point destination;
+    Square moved {};    // Contents of the origin square before the move.
+    Square captured {}; // Contents of the destination square before the move.
+    std::optional<Point> en_passant_square = std::nullopt;
+    Square en_passant_captured {};
+    std::optional<std::pair<Point, Point>> castling_rook = std::nullopt;
+    std::pair<Square, Square> castling_squares {}; // Contents of the rook's origin and destination before the move.
+    Point king_position;
+    std::uint64_t hash = 0;
+};
+
+// Checks against a player's king and the pieces pinned to it.
+struct KingSafety {
+    Bitboard checkers {};
+    // Squares a piece other than the king may move to without leaving the king in check; everything if there is no check.
+    Bitboard check_mask {};
+    Bitboard pinned {};
+    // Each pinned piece may only move along the line between the king and its pinner (including capturing the pinner).
+    std::array<std::pair<int, Bitboard>, 8> pins {};
+    int pin_count = 0;
+
+    Bitboard allowed_destinations(int index) const;
+};
+
 class GameState {
 public:
     GameState();
     void reset();
+    // Replaces the position, along with the player to move and the remaining players, with bit 'color' set for each of them.
+    // Bit '2 * color + option' of 'castling_rights' keeps a castling option available, and the pawns marked as having just
+    // double jumped may be taken en passant. Every other 'has_moved' flag is ignored. Returns false and leaves the position
+    // as it was if the result would not be a valid position.
+    bool set_position(std::array<std::array<Square, 14>, 14> board, Color player, int remaining_players, int castling_rights);
     const std::array<std::array<Square, 14>, 14>& get_board() const;
-    std::array<std::array<Square, 14>, 14>& get_board();
+    const Bitboard& get_piece_bitboard(Piece piece) const;
+    const Bitboard& get_color_bitboard(Color color) const;
+    const Bitboard& get_occupied_squares() const;
+    const PieceList& get_pieces(Color color) const;
     bool point_is_of_color(const Point& point, const Color color) const;
     bool move_piece_to(const Point& origin, const Point& destination, bool enforce_king_protection);
+    MoveUndo make_move(const Point& origin, const Point& destination);
+    MoveUndo make_move(const Move& move);
+    void unmake_move(const MoveUndo& undo);
     bool may_promote(const Point& position, const Color& player) const;
+    bool promote(const Point& position, Piece piece);
     void advance_turn();
+    // Also generates the legal moves of the player whose turn it is next, as deciding whether they have been eliminated takes most of that work anyway.
+    void advance_turn(MoveList& legal_moves);
     Color get_current_player() const;
-    const std::vector<Color>& get_current_players() const;
+    PlayerSet get_current_players() const;
     bool player_exists(Color player) const;
     std::pair<bool, Point> square_is_under_attack_for_player(Point position, Color player) const;
+    KingSafety get_king_safety(Color player) const;
+    int get_attack_count(Point position, Color attacker) const;
+    // The material the player to move wins by playing 'first', a legal move onto 'target', once the other players have
+    // recaptured in turn for as long as it pays off for them, with a pawn worth 100. Pieces of eliminated players are worth
+    // nothing and never recapture. Nothing is played on the board, so this is cheap enough to call on every capture.
+    int static_exchange(Point target, Move first) const;
+    bool attack_maps_are_consistent() const;
+    bool piece_lists_are_consistent() const;
+    std::uint64_t get_hash() const;
+    const Evaluator& get_evaluator() const { return m_evaluator; }
+    Evaluator compute_evaluator() const;
+    // Keeps the accumulators of 'network' up to date from now on, or stops doing so if it is null. The network is kept by
+    // 'reset', 'set_position' and copies, and must outlive them all.
+    void set_network(const Network* network);
+    const Network* get_network() const { return m_network; }
+    // The output of the network for every color, indexed by color. Only valid while a network is set.
+    std::array<int, 4> evaluate_network() const;
+    std::array<Network::Accumulator, 4> compute_accumulators() const;
+    int castling_rights() const;
+    std::uint64_t compute_hash() const;
     std::vector<Point> get_valid_moves_for_position(Point position, Color player, bool enforce_king_protection) const;
+    void get_valid_moves_for_position(Point position, Color player, bool enforce_king_protection, MoveList& valid_moves) const;
+    void generate_legal_moves(Color player, MoveList& legal_moves) const;
+    bool has_legal_move(Color player) const;
     std::vector<Point> get_valid_moves_for_rook(Point position, Color player, bool enforce_king_protection) const;
     std::vector<Point> get_valid_moves_for_bishop(const Point position, Color player, bool enforce_king_protection) const;
     std::vector<Point> get_valid_moves_for_king(Point position, Color player) const;
@@ -79,25 +372,134 @@ public:
     std::vector<Point> get_valid_moves_for_pawn(Point position, Color player, bool enforce_king_protection) const;
 
 private:
-    void complete_castling_if_needed(FPC::Point origin, FPC::Point destination);
-    std::vector<Point> get_valid_moves_for_king_lite(Point position, Color player) const;
-    std::vector<Point> filter_moves(const Point origin, std::vector<Point>& valid_moves, const Color player, bool enforce_king_protection) const;
+    void advance_turn(MoveList* legal_moves);
+    bool has_obviously_legal_move(Color player) const;
+    std::optional<std::pair<Point, Point>> castling_rook_move(FPC::Point origin, FPC::Point destination) const;
+    void add_moves_for_rook(Point position, Color player, MoveList& valid_moves) const;
+    void add_moves_for_bishop(Point position, Color player, MoveList& valid_moves) const;
+    void add_moves_for_king(Point position, Color player, MoveList& valid_moves) const;
+    void add_moves_for_queen(Point position, Color player, MoveList& valid_moves) const;
+    void add_moves_for_knight(Point position, Color player, MoveList& valid_moves) const;
+    void add_moves_for_pawn(Point position, Color player, MoveList& valid_moves) const;
+    void add_pseudo_legal_moves(Point position, Color player, MoveList& valid_moves) const;
+    void add_pseudo_legal_moves(Point position, Piece piece, Color player, MoveList& valid_moves) const;
+    // The color-specific halves of the functions above, instantiated once per color in library.cpp.
+    template<Color C>
+    void generate_legal_moves(MoveList& legal_moves) const;
+    template<Color C>
+    bool has_legal_move() const;
+    template<Color C>
+    void add_pseudo_legal_moves(Point position, Piece piece, MoveList& valid_moves) const;
+    template<Color C>
+    void add_moves_for_king(Point position, MoveList& valid_moves) const;
+    template<Color C>
+    void add_moves_for_pawn(int origin, MoveList& valid_moves) const;
+    void remove_illegal_moves(const KingSafety& safety, const Point origin, MoveList& valid_moves, int first, const Color player) const;
+    std::vector<Point> filter_moves(const Point origin, MoveList& valid_moves, const Color player, bool enforce_king_protection) const;
+    void set_square(const Point& position, const Square& square);
+    Bitboard attackers_of(int index, const Bitboard& occupied) const;
+    std::array<int, 4> exchange_outcome(int index, const Bitboard& occupied, Color owner, int value, int depth) const;
+    Bitboard attacks_from(int index, Piece piece, Color color, const Bitboard& occupied) const;
+    void update_attacks_from(int index, Piece piece, Color color, int delta);
+    void update_rays_through(int index, int delta);
+    void count_attacks(std::array<std::array<std::uint8_t, 196>, 4>& counts) const;
+    bool is_attacked(int index, Color player) const;
+    void set_just_double_jumped(const Point& position, bool just_double_jumped);
+    void verify_incremental_state() const;
+    void update_evaluator(int index, Piece piece, Color color, int delta);
+    int king_shelter(Color color) const;
+    std::array<int, 4> network_features(int index, Piece piece, Color color) const;
+    Bitboard enemies_of(Color player) const;
     void unsafe_move_piece_to(const Point& origin, const Point& destination);
     bool empty_square(const Point& square);
-    void iterate_from(std::vector<Point>& valid_moves, const Color player, const Point& original_position, const Point& increment_map) const;
+    void iterate_from(MoveList& valid_moves, const Color player, const Point& original_position, int direction) const;
     std::array<std::array<Square, 14>, 14> m_board;
+    // These mirror 'm_board' and are kept in sync by 'set_square'.
+    std::array<Bitboard, 6> m_piece_bitboards {};
+    std::array<Bitboard, 4> m_color_bitboards {};
+    Bitboard m_occupied {};
+    // Also kept in sync by 'set_square', along with the position of every occupied square within its color's list.
+    std::array<PieceList, 4> m_piece_lists {};
+    std::array<std::uint8_t, 196> m_piece_list_slots {};
+    // How many pieces of each color attack each square, indexed by color and then by square index.
+    // Kept up to date by 'set_square'; building with FPC_VERIFY_INCREMENTAL_STATE checks them against a full recomputation after every move.
+    std::array<std::array<std::uint8_t, 196>, 4> m_attack_counts {};
+    // Zobrist key of the pieces, side to move, castling rights, en passant flags and eliminated players.
+    // Like the attack maps, it is updated as the position changes rather than recomputed.
+    std::uint64_t m_hash = 0;
+    // Updated in 'set_square' along with everything above.
+    Evaluator m_evaluator;
+    // Indexed by the color whose view of the board they hold, and only kept while 'm_network' is set.
+    const Network* m_network = nullptr;
+    std::array<Network::Accumulator, 4> m_accumulators {};
     Color m_player {Color::Red};
     // Must be accessed in the same order as the 'Color' enum.
     std::array<Point, 4> m_king_positions {Point {7, 13}, Point {0, 6}, Point {6, 0}, Point {13, 7}};
-    std::vector<Color> m_current_players {
-        Color::Red,
-        Color::Blue,
-        Color::Yellow,
-        Color::Green,
+    PlayerSet m_current_players {0xf};
+};
+
+// Hands out game states from blocks of 'block_size', reusing released ones first, so that hosting thousands of games takes
+// a handful of allocations. As 'GameState' is trivially copyable, acquiring one is a plain copy of its bytes.
+class GameStatePool {
+public:
+    static constexpr std::size_t block_size = 1024;
+
+    GameStatePool() = default;
+    GameStatePool(const GameStatePool&) = delete;
+    GameStatePool& operator=(const GameStatePool&) = delete;
+
+    // Returns a copy of 'game', or of the initial position.
+    GameState* acquire(const GameState& game);
+    GameState* acquire();
+    // 'game' must have come from this pool, and must not be used afterwards.
+    void release(GameState* game);
+
+    // How many game states are in use, and how many fit in the blocks allocated so far.
+    std::size_t size() const { return m_size; }
+    std::size_t capacity() const { return m_blocks.size() * block_size; }
+
+private:
+    struct alignas(GameState) Slot {
+        unsigned char bytes[sizeof(GameState)];
     };
+
+    std::vector<std::unique_ptr<Slot[]>> m_blocks;
+    std::vector<Slot*> m_free;
+    std::size_t m_used = block_size; // Slots handed out from the last block.
+    std::size_t m_size = 0;
 };
 
 void get_piece_name(const GameState& game, int x, int y);
 bool is_valid_position(const FPC::Point& position);
+bool is_promotion_square(const Point& position, Color player);
+
+// Moves are written as origin and destination squares, with files 'a' to 'n' from left to right and ranks 1 to 14 from
+// Red's side of the board, followed by the promoted piece if any. For example: "h2h4" or "e13e14q".
+std::string move_to_string(const Move& move);
+std::optional<Move> parse_move(const GameState& game, std::string_view text);
+
+// Positions are written as five space-separated fields, for example the initial position:
+// "3yRyNyByKyQyByNyR3/3yPyPyPyPyPyPyPyP3/14/bRbP10gPgR/bNbP10gPgN/bBbP10gPgB/bKbP10gPgQ/bQbP10gPgK/bBbP10gPgB/bNbP10gPgN/
+//  bRbP10gPgR/14/3rPrPrPrPrPrPrPrP3/3rRrNrBrQrKrBrNrR3 r rbyg rKQbKQyKQgKQ -"
+// - The ranks from 14 down to 1, separated by '/'. Each piece is its color ('r', 'b', 'y' or 'g') followed by its kind
+//   ('K', 'Q', 'R', 'B', 'N' or 'P'), and a number stands for that many empty squares, counting the corners as empty.
+// - The player to move.
+// - The remaining players.
+// - The castling options left, '-' for none: a color followed by 'K' for the king's side and 'Q' for the queen's side.
+// - The pawns which may be taken en passant, as a comma-separated list of the squares they stand on, '-' for none.
+// Writing and parsing neither allocate nor accept anything 'GameState::set_position' would not.
+constexpr std::size_t max_position_length = 14 * 28 + 13 + 48;
+// Writes at most 'max_position_length' characters to 'buffer', without a terminating null, and returns how many it wrote.
+std::size_t write_position(const GameState& game, char* buffer);
+std::string position_to_string(const GameState& game);
+bool parse_position(GameState& game, std::string_view text);
+
+// A position in 61 bytes, padded to 64: the player to move and the remaining players, a bit for each playable square telling
+// whether it is occupied, and five bits for each piece giving its color and kind. Pawns which may be taken en passant and
+// rooks which may still castle have codes of their own.
+using PackedPosition = std::array<std::uint8_t, 64>;
+PackedPosition pack_position(const GameState& game);
+bool unpack_position(GameState& game, const PackedPosition& packed);
+const Bitboard& playable_squares();
 
 }
@@ -80,7 +80,7 @@ int main() {
                         };
                         for (int i = 0; i < 4; ++i) {
                             if (is_equal(interface_state.promotion_selection[i], current_square)) {
-                                interface_state.game->get_board()[interface_state.square.x][interface_state.square.y].piece = static_cast<FPC::Piece>(i);
+                                interface_state.game->promote(interface_state.square, static_cast<FPC::Piece>(i));
                                 interface_state.promotion_dialog_active = false;
                                 interface_state.game->advance_turn();
                             }
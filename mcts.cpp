@@ -0,0 +1,274 @@
+#include "mcts.h"
+#include "search.h"
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace FPC {
+
+namespace {
+
+enum NodeState : std::uint8_t {
+    Unexpanded,
+    Expanding,
+    Expanded,
+};
+
+// Rewards are summed as integers, with 'Search::max_score' standing for a full reward.
+constexpr double s_reward_scale = Search::max_score;
+
+}
+
+struct MonteCarloTreeSearch::Node {
+    Move move {}; // The move leading here from the parent.
+    Node* children = nullptr;
+    std::uint16_t child_count = 0;
+    std::atomic<std::uint8_t> state {Unexpanded};
+    std::atomic<std::uint32_t> visits {0};
+    std::atomic<std::uint32_t> virtual_loss {0};
+    // Indexed by color.
+    std::array<std::atomic<std::uint64_t>, 4> rewards {};
+
+    void reset(Move new_move) {
+        move = new_move;
+        children = nullptr;
+        child_count = 0;
+        state.store(Unexpanded, std::memory_order_relaxed);
+        visits.store(0, std::memory_order_relaxed);
+        virtual_loss.store(0, std::memory_order_relaxed);
+        for (auto& reward : rewards)
+            reward.store(0, std::memory_order_relaxed);
+    }
+};
+
+// Hands out nodes from large blocks. Clearing the arena keeps the blocks for the next search, so a long session does not
+// keep returning memory to the heap and asking for it again.
+class MonteCarloTreeSearch::Arena {
+public:
+    static constexpr std::size_t block_size = 16384;
+
+    // The nodes are contiguous, which keeps siblings in as few cache lines as possible.
+    Node* allocate(std::size_t count) {
+        if (m_blocks.empty() || m_used + count > block_size) {
+            if (++m_current >= m_blocks.size()) {
+                m_blocks.push_back(std::make_unique<Node[]>(block_size));
+                m_current = m_blocks.size() - 1;
+            }
+            m_used = 0;
+        }
+        Node* nodes = &m_blocks[m_current][m_used];
+        m_used += count;
+        m_size.fetch_add(count, std::memory_order_relaxed);
+        return nodes;
+    }
+
+    void clear() {
+        m_current = std::numeric_limits<std::size_t>::max();
+        m_used = block_size;
+        m_size.store(0, std::memory_order_relaxed);
+    }
+
+    // How many nodes are in use; may be read by any thread.
+    std::size_t size() const { return m_size.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<std::unique_ptr<Node[]>> m_blocks;
+    std::size_t m_current = std::numeric_limits<std::size_t>::max();
+    std::size_t m_used = block_size;
+    std::atomic<std::size_t> m_size {0};
+};
+
+struct MonteCarloTreeSearch::Worker {
+    // A leaf waiting to be played out, along with the nodes leading to it from the root.
+    struct PendingPlayout {
+        GameState game;
+        std::vector<Node*> path;
+    };
+
+    int index = 0;
+    Arena arena;
+    std::uint64_t random_state = 0;
+    std::vector<PendingPlayout> batch;
+
+    // xorshift64*, which is plenty for picking random moves.
+    std::uint32_t random(std::uint32_t bound) {
+        random_state ^= random_state >> 12;
+        random_state ^= random_state << 25;
+        random_state ^= random_state >> 27;
+        return static_cast<std::uint32_t>(((random_state * 0x2545f4914f6cdd1d) >> 32) * bound >> 32);
+    }
+};
+
+MonteCarloTreeSearch::MonteCarloTreeSearch() {
+    set_thread_count(1);
+}
+
+MonteCarloTreeSearch::~MonteCarloTreeSearch() = default;
+
+void MonteCarloTreeSearch::set_thread_count(int thread_count) {
+    m_workers.resize(std::max(thread_count, 1));
+    for (std::size_t i = 0; i < m_workers.size(); ++i) {
+        if (!m_workers[i])
+            m_workers[i] = std::make_unique<Worker>();
+        m_workers[i]->index = static_cast<int>(i);
+    }
+}
+
+void MonteCarloTreeSearch::stop() {
+    m_stop_requested.store(true, std::memory_order_relaxed);
+}
+
+std::size_t MonteCarloTreeSearch::get_tree_size() const {
+    std::size_t size = 0;
+    for (const auto& worker : m_workers)
+        size += worker->arena.size();
+    return size;
+}
+
+MonteCarloTreeSearch::Node* MonteCarloTreeSearch::select_child(const Node& node, Color player) const {
+    const auto player_index = static_cast<int>(player);
+    const auto parent_visits = node.visits.load(std::memory_order_relaxed) + node.virtual_loss.load(std::memory_order_relaxed);
+    const double log_parent_visits = std::log(std::max<double>(parent_visits, 1));
+
+    Node* best = nullptr;
+    double best_bound = -1;
+    for (int i = 0; i < node.child_count; ++i) {
+        auto& child = node.children[i];
+        // A pending playout counts as a visit which has not won anything yet.
+        const auto visits = child.visits.load(std::memory_order_relaxed) + child.virtual_loss.load(std::memory_order_relaxed);
+        if (visits == 0)
+            return &child;
+        const double reward = child.rewards[player_index].load(std::memory_order_relaxed) / s_reward_scale;
+        const double bound = reward / visits + m_exploration * std::sqrt(log_parent_visits / visits);
+        if (bound > best_bound) {
+            best_bound = bound;
+            best = &child;
+        }
+    }
+    return best;
+}
+
+bool MonteCarloTreeSearch::expand(Worker& worker, Node& node, const GameState& game) {
+    if (get_tree_size() * sizeof(Node) >= m_memory_limit)
+        return false;
+    // Only one thread may add the children; the others keep treating the node as a leaf until it is done.
+    auto expected = static_cast<std::uint8_t>(Unexpanded);
+    if (!node.state.compare_exchange_strong(expected, Expanding, std::memory_order_acquire))
+        return false;
+
+    MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    node.children = worker.arena.allocate(moves.size());
+    for (int i = 0; i < moves.size(); ++i)
+        node.children[i].reset(moves[i]);
+    node.child_count = static_cast<std::uint16_t>(moves.size());
+    node.state.store(Expanded, std::memory_order_release);
+    return true;
+}
+
+void MonteCarloTreeSearch::play_out(Worker& worker, GameState& game, std::array<int, 4>& rewards) const {
+    MoveList moves;
+    if (game.get_current_players().size() > 1)
+        game.generate_legal_moves(game.get_current_player(), moves);
+    for (int ply = 0; ply < m_playout_ply_limit && game.get_current_players().size() > 1; ++ply) {
+        game.make_move(moves[worker.random(moves.size())]);
+        game.advance_turn(moves);
+    }
+    rewards = evaluate(game);
+}
+
+void MonteCarloTreeSearch::work(Worker& worker, const GameState& root_game) {
+    const std::uint32_t virtual_loss = m_virtual_loss;
+    worker.batch.resize(m_batch_size);
+    while (!m_stop_requested.load(std::memory_order_relaxed)) {
+        for (auto& pending : worker.batch) {
+            auto& game = pending.game;
+            auto& path = pending.path;
+            game = root_game;
+            path.clear();
+
+            Node* node = m_root;
+            node->virtual_loss.fetch_add(virtual_loss, std::memory_order_relaxed);
+            path.push_back(node);
+            while (game.get_current_players().size() > 1) {
+                if (node->state.load(std::memory_order_acquire) != Expanded) {
+                    const bool is_ready = node == m_root || node->visits.load(std::memory_order_relaxed) >= static_cast<std::uint32_t>(m_expansion_threshold);
+                    if (!is_ready || !expand(worker, *node, game))
+                        break;
+                }
+                node = select_child(*node, game.get_current_player());
+                game.make_move(node->move);
+                game.advance_turn();
+                node->virtual_loss.fetch_add(virtual_loss, std::memory_order_relaxed);
+                path.push_back(node);
+            }
+        }
+
+        for (auto& pending : worker.batch) {
+            std::array<int, 4> rewards {};
+            play_out(worker, pending.game, rewards);
+            for (auto* node : pending.path) {
+                for (int i = 0; i < 4; ++i)
+                    node->rewards[i].fetch_add(rewards[i], std::memory_order_relaxed);
+                node->visits.fetch_add(1, std::memory_order_relaxed);
+                node->virtual_loss.fetch_sub(virtual_loss, std::memory_order_relaxed);
+            }
+        }
+
+        const auto playouts = m_playouts.fetch_add(worker.batch.size(), std::memory_order_relaxed) + worker.batch.size();
+        if ((m_limits.playouts > 0 && playouts >= m_limits.playouts)
+            || (m_limits.time.count() > 0 && std::chrono::steady_clock::now() - m_start >= m_limits.time))
+            stop();
+    }
+}
+
+MonteCarloResult MonteCarloTreeSearch::run(const GameState& game, const MonteCarloLimits& limits) {
+    m_start = std::chrono::steady_clock::now();
+    m_limits = limits;
+    m_stop_requested.store(false, std::memory_order_relaxed);
+    m_playouts.store(0, std::memory_order_relaxed);
+    for (auto& worker : m_workers) {
+        worker->arena.clear();
+        worker->random_state = m_seed + 0x9e3779b97f4a7c15 * (worker->index + 1);
+    }
+
+    MonteCarloResult result {};
+    if (game.get_current_players().size() <= 1)
+        return result;
+
+    m_root = m_workers[0]->arena.allocate(1);
+    m_root->reset(Move {});
+    std::vector<std::thread> helpers;
+    for (std::size_t i = 1; i < m_workers.size(); ++i)
+        helpers.emplace_back([this, &game, i] { work(*m_workers[i], game); });
+    work(*m_workers[0], game);
+    for (auto& helper : helpers)
+        helper.join();
+
+    // Follow the most visited children, which is less noisy than the highest average reward.
+    const Node* node = m_root;
+    while (node->state.load(std::memory_order_acquire) == Expanded && node->child_count > 0) {
+        const Node* best = &node->children[0];
+        for (int i = 1; i < node->child_count; ++i) {
+            if (node->children[i].visits.load(std::memory_order_relaxed) > best->visits.load(std::memory_order_relaxed))
+                best = &node->children[i];
+        }
+        if (best->visits.load(std::memory_order_relaxed) == 0)
+            break;
+        result.principal_variation.push_back(best->move);
+        if (node == m_root) {
+            const auto visits = best->visits.load(std::memory_order_relaxed);
+            for (int i = 0; i < 4; ++i)
+                result.rewards[i] = best->rewards[i].load(std::memory_order_relaxed) / s_reward_scale / visits;
+        }
+        node = best;
+    }
+    if (!result.principal_variation.empty())
+        result.best_move = result.principal_variation.front();
+    result.playouts = m_playouts.load(std::memory_order_relaxed);
+    result.tree_size = get_tree_size();
+    result.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start);
+    return result;
+}
+
+}
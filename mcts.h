@@ -0,0 +1,96 @@
+#pragma once
+
+#include "library.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace FPC {
+
+// A search stops at whichever limit it reaches first. A limit of zero means no limit.
+struct MonteCarloLimits {
+    std::uint64_t playouts = 0;
+    std::chrono::milliseconds time {0};
+};
+
+struct MonteCarloResult {
+    Move best_move {};
+    // The average reward of every player over the playouts through the best move, from 0 to 1, indexed by color.
+    std::array<double, 4> rewards {};
+    std::uint64_t playouts = 0;
+    std::size_t tree_size = 0;
+    std::chrono::milliseconds time {0};
+    // The most visited path from the root.
+    std::vector<Move> principal_variation;
+};
+
+// Chooses a move by Monte Carlo tree search. Every playout ends with a reward for each of the four players: the winner
+// gets everything, and if the playout is cut short, the remaining players share it as the evaluation of its last position says.
+// When descending the tree, the player to move picks the child with the highest upper confidence bound on their own reward.
+//
+// All threads work on the same tree. Each of them selects a batch of leaves, plays them out and only then backs up the
+// results; meanwhile, every node on the way to a pending leaf counts a virtual loss, which steers the other selections elsewhere.
+// Nodes come from arenas owned by the thread that expanded them, which are emptied but kept between searches.
+class MonteCarloTreeSearch {
+public:
+    MonteCarloTreeSearch();
+    ~MonteCarloTreeSearch();
+
+    MonteCarloTreeSearch(const MonteCarloTreeSearch&) = delete;
+    MonteCarloTreeSearch& operator=(const MonteCarloTreeSearch&) = delete;
+
+    // Always returns a legal move if the player to move has one.
+    MonteCarloResult run(const GameState& game, const MonteCarloLimits& limits);
+    // May be called from any thread to make a running search return as soon as possible.
+    void stop();
+
+    // The thread calling 'run' searches as well, so a count of one means no additional threads.
+    void set_thread_count(int thread_count);
+    int get_thread_count() const { return static_cast<int>(m_workers.size()); }
+    void set_exploration(double exploration) { m_exploration = exploration; }
+    // How many visits each pending playout adds to the nodes on its path.
+    void set_virtual_loss(int virtual_loss) { m_virtual_loss = virtual_loss; }
+    void set_batch_size(int batch_size) { m_batch_size = std::max(batch_size, 1); }
+    // How many visits a leaf needs before its children are added to the tree.
+    void set_expansion_threshold(int visits) { m_expansion_threshold = visits; }
+    // Playouts that are still undecided after this many plies are scored by the evaluation.
+    void set_playout_ply_limit(int plies) { m_playout_ply_limit = plies; }
+    // Once the tree takes up this much memory, it stops growing and further playouts only refine the existing nodes.
+    void set_memory_limit(std::size_t megabytes) { m_memory_limit = megabytes * 1024 * 1024; }
+    // With a single thread, the same seed and a playout limit, searches are reproducible.
+    void set_seed(std::uint64_t seed) { m_seed = seed; }
+
+private:
+    struct Node;
+    class Arena;
+    struct Worker;
+
+    void work(Worker& worker, const GameState& root_game);
+    Node* select_child(const Node& node, Color player) const;
+    bool expand(Worker& worker, Node& node, const GameState& game);
+    void play_out(Worker& worker, GameState& game, std::array<int, 4>& rewards) const;
+    std::size_t get_tree_size() const;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    double m_exploration = 1.0;
+    int m_virtual_loss = 3;
+    int m_batch_size = 8;
+    int m_expansion_threshold = 4;
+    int m_playout_ply_limit = 100;
+    std::size_t m_memory_limit = std::size_t(256) * 1024 * 1024;
+    std::uint64_t m_seed = 0x4650432d4d435453;
+
+    // State of the running search. Apart from the atomics, it is only written before the other search threads start.
+    Node* m_root = nullptr;
+    std::atomic<bool> m_stop_requested {false};
+    std::atomic<std::uint64_t> m_playouts {0};
+    MonteCarloLimits m_limits;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+}
@@ -0,0 +1,219 @@
+#include "nnue.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace FPC {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Network files are used as they are mapped, which takes a little-endian machine.");
+
+namespace {
+
+constexpr std::size_t s_weight_count = static_cast<std::size_t>(Network::feature_count + 2) * Network::hidden_size;
+constexpr std::size_t s_file_size = NetworkFormat::header_size + 2 * s_weight_count;
+
+std::uint32_t read_u32(const std::uint8_t* data) {
+    std::uint32_t value;
+    std::memcpy(&value, data, 4);
+    return value;
+}
+
+// The kernels work through the accumulator in whole registers, so the hidden layer must fill a whole number of them.
+#if defined(__AVX2__)
+constexpr int s_lanes = 16;
+#elif defined(__SSE2__)
+constexpr int s_lanes = 8;
+#else
+constexpr int s_lanes = 1;
+#endif
+static_assert(Network::hidden_size % s_lanes == 0);
+
+// Adds 'sign' times 'weights' to 'accumulator'. Overflow wraps around, so that removing a feature always undoes adding it.
+template<int sign>
+void update_accumulator(std::int16_t* accumulator, const std::int16_t* weights) {
+#if defined(__AVX2__)
+    for (int i = 0; i < Network::hidden_size; i += s_lanes) {
+        const auto sum = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i));
+        const auto column = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accumulator + i), sign > 0 ? _mm256_add_epi16(sum, column) : _mm256_sub_epi16(sum, column));
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < Network::hidden_size; i += s_lanes) {
+        const auto sum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(accumulator + i));
+        const auto column = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(accumulator + i), sign > 0 ? _mm_add_epi16(sum, column) : _mm_sub_epi16(sum, column));
+    }
+#else
+    for (int i = 0; i < Network::hidden_size; ++i)
+        accumulator[i] = static_cast<std::int16_t>(static_cast<std::uint16_t>(accumulator[i]) + static_cast<std::uint16_t>(sign * weights[i]));
+#endif
+}
+
+// The dot product of the clipped accumulator with the output weights.
+int output_sum(const std::int16_t* accumulator, const std::int16_t* weights) {
+#if defined(__AVX2__)
+    const auto zero = _mm256_setzero_si256();
+    const auto limit = _mm256_set1_epi16(Network::activation_limit);
+    auto sum = _mm256_setzero_si256();
+    for (int i = 0; i < Network::hidden_size; i += s_lanes) {
+        const auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i));
+        const auto clipped = _mm256_min_epi16(_mm256_max_epi16(values, zero), limit);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(clipped, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i))));
+    }
+    auto half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+    return _mm_cvtsi128_si32(half);
+#elif defined(__SSE2__)
+    const auto zero = _mm_setzero_si128();
+    const auto limit = _mm_set1_epi16(Network::activation_limit);
+    auto sum = _mm_setzero_si128();
+    for (int i = 0; i < Network::hidden_size; i += s_lanes) {
+        const auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(accumulator + i));
+        const auto clipped = _mm_min_epi16(_mm_max_epi16(values, zero), limit);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(clipped, _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + i))));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int sum = 0;
+    for (int i = 0; i < Network::hidden_size; ++i)
+        sum += std::clamp<int>(accumulator[i], 0, Network::activation_limit) * weights[i];
+    return sum;
+#endif
+}
+
+}
+
+const char* Network::get_kernel_name() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+Network::~Network() {
+    unmap();
+}
+
+bool Network::load(const std::string& path) {
+    const int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+    struct stat status {};
+    if (fstat(descriptor, &status) != 0 || static_cast<std::size_t>(status.st_size) != s_file_size) {
+        ::close(descriptor);
+        return false;
+    }
+    void* data = mmap(nullptr, s_file_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+    if (data == MAP_FAILED)
+        return false;
+    // Evaluation reads the feature weights of whichever pieces moved, all over the file.
+    madvise(data, s_file_size, MADV_WILLNEED);
+
+    if (!is_valid(static_cast<const std::uint8_t*>(data))) {
+        munmap(data, s_file_size);
+        return false;
+    }
+    unmap();
+    point_at(static_cast<const std::uint8_t*>(data));
+    m_mapped = true;
+    return true;
+}
+
+void Network::randomize(std::uint64_t seed) {
+    unmap();
+    std::vector<std::uint8_t> buffer(s_file_size);
+    std::memcpy(buffer.data(), NetworkFormat::magic.data(), NetworkFormat::magic.size());
+    const std::array<std::uint32_t, 4> fields {NetworkFormat::version, feature_count, hidden_size, 0};
+    std::memcpy(buffer.data() + NetworkFormat::magic.size(), fields.data(), sizeof(fields));
+
+    // xorshift64*, with feature weights small enough that a full board stays well within 16 bits.
+    std::uint64_t state = seed | 1;
+    auto random = [&](int bound) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return static_cast<std::int16_t>(static_cast<int>(((state * 0x2545f4914f6cdd1d) >> 32) % (2 * bound + 1)) - bound);
+    };
+    auto* weights = reinterpret_cast<std::int16_t*>(buffer.data() + NetworkFormat::header_size);
+    for (int i = 0; i < feature_count * hidden_size; ++i)
+        weights[i] = random(16);
+    for (int i = 0; i < hidden_size; ++i) {
+        weights[feature_count * hidden_size + i] = static_cast<std::int16_t>(32 + random(16));
+        weights[(feature_count + 1) * hidden_size + i] = random(64);
+    }
+    m_buffer = std::move(buffer);
+    point_at(m_buffer.data());
+}
+
+bool Network::save(const std::string& path) const {
+    if (!is_loaded())
+        return false;
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    const bool is_written = std::fwrite(m_data, 1, m_size, file) == m_size;
+    return std::fclose(file) == 0 && is_written;
+}
+
+void Network::reset(std::array<Accumulator, 4>& accumulators) const {
+    for (auto& accumulator : accumulators)
+        std::copy(m_hidden_biases, m_hidden_biases + hidden_size, accumulator.begin());
+}
+
+void Network::add_features(std::array<Accumulator, 4>& accumulators, const std::array<int, 4>& features) const {
+    for (int i = 0; i < 4; ++i)
+        update_accumulator<1>(accumulators[i].data(), m_feature_weights + features[i] * hidden_size);
+}
+
+void Network::remove_features(std::array<Accumulator, 4>& accumulators, const std::array<int, 4>& features) const {
+    for (int i = 0; i < 4; ++i)
+        update_accumulator<-1>(accumulators[i].data(), m_feature_weights + features[i] * hidden_size);
+}
+
+int Network::evaluate(const Accumulator& accumulator) const {
+    return (output_sum(accumulator.data(), m_output_weights) + m_output_bias) / output_divisor;
+}
+
+void Network::unmap() {
+    if (m_mapped)
+        munmap(const_cast<std::uint8_t*>(m_data), m_size);
+    m_mapped = false;
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+    m_feature_weights = m_hidden_biases = m_output_weights = nullptr;
+    m_output_bias = 0;
+}
+
+bool Network::is_valid(const std::uint8_t* data) {
+    return std::equal(NetworkFormat::magic.begin(), NetworkFormat::magic.end(), data) && read_u32(data + 8) == NetworkFormat::version
+        && read_u32(data + 12) == feature_count && read_u32(data + 16) == hidden_size;
+}
+
+// Expects 'data' to hold a whole valid network.
+void Network::point_at(const std::uint8_t* data) {
+    m_data = data;
+    m_size = s_file_size;
+    m_output_bias = static_cast<std::int32_t>(read_u32(data + 20));
+    m_feature_weights = reinterpret_cast<const std::int16_t*>(data + NetworkFormat::header_size);
+    m_hidden_biases = m_feature_weights + feature_count * hidden_size;
+    m_output_weights = m_hidden_biases + hidden_size;
+}
+
+}
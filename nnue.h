@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace FPC {
+
+// Network files are a header followed by the weights, all little-endian and mapped into memory as they are, so that
+// loading a network costs next to nothing and every process using the same file shares its pages.
+//
+// - The header holds the magic "FPCNNUE1", the format version, the number of features, the number of hidden units and the
+//   output bias (32 bits each), padded with zeros to 'header_size' bytes.
+// - Then come the feature weights (16 bits each, 'Network::hidden_size' per feature), the hidden biases and the output
+//   weights (16 bits each, 'Network::hidden_size' of both).
+namespace NetworkFormat {
+
+constexpr std::array<char, 8> magic {'F', 'P', 'C', 'N', 'N', 'U', 'E', '1'};
+constexpr std::uint32_t version = 1;
+constexpr std::size_t header_size = 64;
+
+}
+
+// A small efficiently updatable network. Every player sees the board through their own accumulator: the sum of the
+// feature weights of every piece on the board, described by its kind, how many turns after the player its owner moves and
+// its square counted from the player's side of the board. As a move only adds and removes a few features, 'GameState'
+// keeps the accumulators up to date as pieces come and go, and evaluating a position only takes the output layer.
+//
+// The output of a player is the dot product of their accumulator, clipped to [0, 'activation_limit'], with the output
+// weights, plus the output bias, divided by 'output_divisor'. It is meant to be in centipawns, like 'Evaluator'.
+class Network {
+public:
+    static constexpr int hidden_size = 32;
+    static constexpr int square_count = 160; // Playable squares.
+    static constexpr int feature_count = 6 * 4 * square_count;
+    static constexpr int activation_limit = 127;
+    static constexpr int output_divisor = 64;
+
+    using Accumulator = std::array<std::int16_t, hidden_size>;
+
+    // 'piece' is in the order of the 'Piece' enum, 'relative_color' is zero for the player's own pieces and 'square'
+    // is the index of the square among the playable ones, as seen by the player.
+    static constexpr int feature_index(int piece, int relative_color, int square) {
+        return (piece * 4 + relative_color) * square_count + square;
+    }
+
+    // The instruction set the kernels were built for.
+    static const char* get_kernel_name();
+
+    Network() = default;
+    ~Network();
+
+    Network(const Network&) = delete;
+    Network& operator=(const Network&) = delete;
+
+    // Maps the file into memory. Returns false and keeps the previous weights if it is not a valid network.
+    bool load(const std::string& path);
+    // Replaces the weights with small random ones, for benchmarks and as a starting point for training.
+    void randomize(std::uint64_t seed);
+    bool save(const std::string& path) const;
+    bool is_loaded() const { return m_data != nullptr; }
+
+    // Sets every accumulator to the hidden biases.
+    void reset(std::array<Accumulator, 4>& accumulators) const;
+    // Adds or removes one feature from each accumulator, the n-th feature from the n-th accumulator.
+    void add_features(std::array<Accumulator, 4>& accumulators, const std::array<int, 4>& features) const;
+    void remove_features(std::array<Accumulator, 4>& accumulators, const std::array<int, 4>& features) const;
+    int evaluate(const Accumulator& accumulator) const;
+
+private:
+    // Whether the header matches the network this build was made for.
+    static bool is_valid(const std::uint8_t* data);
+    void point_at(const std::uint8_t* data);
+    void unmap();
+
+    // Either mapped from a file or pointing into 'm_buffer'.
+    const std::uint8_t* m_data = nullptr;
+    std::size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<std::uint8_t> m_buffer;
+
+    const std::int16_t* m_feature_weights = nullptr;
+    const std::int16_t* m_hidden_biases = nullptr;
+    const std::int16_t* m_output_weights = nullptr;
+    std::int32_t m_output_bias = 0;
+};
+
+}
@@ -0,0 +1,191 @@
+#include "library.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Node counts of positions that were already counted, shared by all threads without locks. Each entry stores the key XORed
+// with the count next to the count itself, so an entry torn by two concurrent writers simply fails to verify.
+class PerftTable {
+public:
+    explicit PerftTable(std::size_t size_in_megabytes)
+        : m_entry_count(std::max<std::size_t>(1, size_in_megabytes * 1024 * 1024 / sizeof(Entry)))
+        , m_entries(std::make_unique<Entry[]>(m_entry_count)) {
+    }
+
+    bool probe(std::uint64_t key, std::uint64_t& nodes) const {
+        const auto& entry = m_entries[key % m_entry_count];
+        nodes = entry.nodes.load(std::memory_order_relaxed);
+        return nodes != 0 && (entry.check.load(std::memory_order_relaxed) ^ nodes) == key;
+    }
+
+    void store(std::uint64_t key, std::uint64_t nodes) {
+        auto& entry = m_entries[key % m_entry_count];
+        entry.check.store(key ^ nodes, std::memory_order_relaxed);
+        entry.nodes.store(nodes, std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        std::atomic<std::uint64_t> check {0};
+        std::atomic<std::uint64_t> nodes {0};
+    };
+
+    std::size_t m_entry_count;
+    std::unique_ptr<Entry[]> m_entries;
+};
+
+// Counts the leaf nodes of the move tree below 'game', in which the player to move has the given legal moves. A finished
+// game is a leaf no matter how much depth remains.
+static std::uint64_t perft(const FPC::GameState& game, const FPC::MoveList& moves, int depth, PerftTable* table) {
+    if (depth == 0 || game.get_current_players().size() <= 1)
+        return 1;
+    if (depth == 1)
+        return moves.size();
+
+    // The same position may be reached with different depths left, so the depth is part of the key.
+    const auto key = game.get_hash() ^ (static_cast<std::uint64_t>(depth) * 0x9e3779b97f4a7c15);
+    std::uint64_t nodes = 0;
+    if (table && table->probe(key, nodes))
+        return nodes;
+
+    nodes = 0;
+    FPC::MoveList child_moves;
+    for (const auto& move : moves) {
+        // Turns cannot be taken back, as they may eliminate players, so each child gets its own copy.
+        auto child = game;
+        child.make_move(move);
+        child.advance_turn(child_moves);
+        nodes += perft(child, child_moves, depth - 1, table);
+    }
+    if (table)
+        table->store(key, nodes);
+    return nodes;
+}
+
+static void print_usage() {
+    std::cout << "Usage: perft <depth> [--threads <count>] [--hash <megabytes>] [--position <position>] [--moves <move>...]\n"
+              << "Counts the positions reachable in <depth> plies, starting from the initial or given position after playing the given moves.\n"
+              << "The first two plies are split into tasks for <count> threads, all cores by default. A hash table of the given size,\n"
+              << "off by default, lets the threads share the counts of transposed positions.\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    int depth = 0;
+    unsigned thread_count = std::thread::hardware_concurrency();
+    std::size_t hash_megabytes = 0;
+    FPC::GameState game;
+    for (int i = 2; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if ((argument == "--threads" || argument == "--hash") && i + 1 < argc) {
+            try {
+                const std::string text = argv[++i];
+                std::size_t length = 0;
+                const auto value = std::stoul(text, &length);
+                if (length != text.size())
+                    throw std::invalid_argument("trailing characters");
+                if (argument == "--threads")
+                    thread_count = static_cast<unsigned>(value);
+                else
+                    hash_megabytes = value;
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else if (argument == "--position" && i + 1 < argc) {
+            if (!FPC::parse_position(game, argv[++i])) {
+                std::cout << "Invalid position: " << argv[i] << '\n';
+                return 1;
+            }
+        } else if (argument == "--moves") {
+            for (++i; i < argc; ++i) {
+                const auto move = FPC::parse_move(game, argv[i]);
+                if (!move.has_value()) {
+                    std::cout << "Illegal move: " << argv[i] << '\n';
+                    return 1;
+                }
+                game.make_move(move.value());
+                game.advance_turn();
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    try {
+        const std::string text = argv[1];
+        std::size_t length = 0;
+        depth = std::stoi(text, &length);
+        if (length != text.size())
+            throw std::invalid_argument("trailing characters");
+    } catch (const std::exception&) {
+        print_usage();
+        return 1;
+    }
+    if (depth < 0) {
+        print_usage();
+        return 1;
+    }
+
+    std::unique_ptr<PerftTable> table;
+    if (hash_megabytes > 0)
+        table = std::make_unique<PerftTable>(hash_megabytes);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::uint64_t nodes = 0;
+    FPC::MoveList moves;
+    if (game.get_current_players().size() > 1)
+        game.generate_legal_moves(game.get_current_player(), moves);
+    if (depth > 0 && game.get_current_players().size() > 1) {
+        std::vector<std::atomic<std::uint64_t>> move_nodes(moves.size());
+        {
+            FPC::ThreadPool pool(thread_count);
+            for (int i = 0; i < moves.size(); ++i) {
+                auto child = game;
+                child.make_move(moves[i]);
+                FPC::MoveList replies;
+                child.advance_turn(replies);
+                if (depth < 3 || child.get_current_players().size() <= 1) {
+                    move_nodes[i] = perft(child, replies, depth - 1, table.get());
+                    continue;
+                }
+
+                // Each reply becomes a task of its own, so that even a few root moves keep every thread busy.
+                for (const auto& reply : replies) {
+                    pool.submit([&, i, child, reply] {
+                        auto grandchild = child;
+                        grandchild.make_move(reply);
+                        FPC::MoveList grandchild_moves;
+                        grandchild.advance_turn(grandchild_moves);
+                        move_nodes[i] += perft(grandchild, grandchild_moves, depth - 2, table.get());
+                    });
+                }
+            }
+            pool.wait_idle();
+        }
+
+        for (int i = 0; i < moves.size(); ++i) {
+            std::cout << FPC::move_to_string(moves[i]) << ": " << move_nodes[i] << '\n';
+            nodes += move_nodes[i];
+        }
+    } else {
+        nodes = perft(game, moves, depth, table.get());
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "\nNodes: " << nodes << '\n'
+              << "Time: " << static_cast<std::uint64_t>(elapsed.count() * 1000) << " ms\n"
+              << "Nodes per second: " << static_cast<std::uint64_t>(nodes / std::max(elapsed.count(), 1e-9)) << '\n';
+    return 0;
+}
@@ -0,0 +1,423 @@
+#include "search.h"
+#include <algorithm>
+#include <thread>
+#ifdef __linux__
+#    include <pthread.h>
+#    include <sched.h>
+#endif
+
+namespace FPC {
+
+namespace {
+
+// Used to order captures, and must be accessed in the same order as the 'Piece' enum. Taking a king, which a player may do
+// once its owner can no longer move it out of the way, is worth more than anything else.
+constexpr std::array<int, 6> s_piece_values {900, 500, 450, 300, 2000, 100};
+
+// Paranoid scores depend on which player the coalition is playing against, so they must not be mixed up with those of
+// another root player, nor with max-n scores.
+constexpr std::array<std::uint64_t, 4> s_paranoid_keys {0x8c3f2b1e9d4a7065, 0x1b5e93c0a2f87d46, 0xe07a4d6b35c9f812, 0x5d92f8e4c17b0a3b};
+
+bool is_quiet(const Move& move) {
+    return !move.has_flag(Move::Capture) && !move.promotion().has_value();
+}
+
+#ifdef __linux__
+// Binds the calling thread to a single core, returning the set of cores it was allowed to run on before.
+cpu_set_t bind_to_core(int core) {
+    cpu_set_t previous;
+    CPU_ZERO(&previous);
+    pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous);
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+    CPU_SET(core, &cores);
+    pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+    return previous;
+}
+#endif
+
+}
+
+std::array<int, 4> evaluate(const GameState& game) {
+    std::array<int, 4> scores {};
+    const auto players = game.get_current_players();
+    if (players.size() == 1) {
+        scores[static_cast<int>(players.front())] = Search::max_score;
+        return scores;
+    }
+
+    // Branch-free over the four colors, so that this compiles to a few vector instructions. Every remaining player keeps
+    // a share, however badly placed their pieces are. A network, if the game has one, replaces the hand-written terms.
+    const auto totals = game.get_network() ? game.evaluate_network() : game.get_evaluator().get_totals();
+    std::array<int, 4> values;
+    int sum = 0;
+    for (int i = 0; i < 4; ++i) {
+        values[i] = ((players.mask() >> i) & 1) * std::max(totals[i], 1);
+        sum += values[i];
+    }
+    const float scale = static_cast<float>(Search::max_score) / static_cast<float>(sum);
+    for (int i = 0; i < 4; ++i)
+        scores[i] = static_cast<int>(static_cast<float>(values[i]) * scale);
+    return scores;
+}
+
+// Everything a thread needs to search on its own, apart from the transposition table. Each thread has its own move
+// ordering tables, so that their searches drift apart instead of all following the same path.
+struct alignas(64) Search::Worker {
+    int index = 0;
+    // Only written by the thread owning the worker, but read by the others to enforce the node limit.
+    std::atomic<std::uint64_t> nodes {0};
+    std::array<std::array<Move, 2>, max_ply> killers {};
+    // Indexed by color, piece and destination square index.
+    std::array<std::array<std::array<int, 196>, 6>, 4> history {};
+    // The principal variation found below each ply, starting at the ply itself.
+    std::array<std::array<Move, max_ply>, max_ply> principal_variation {};
+    std::array<int, max_ply> principal_variation_length {};
+
+    // The result of the deepest iteration this thread has completed.
+    int completed_depth = 0;
+    int score = 0;
+    std::vector<Move> completed_principal_variation;
+
+    void reset() {
+        nodes.store(0, std::memory_order_relaxed);
+        killers = {};
+        history = {};
+        completed_depth = 0;
+        score = 0;
+        completed_principal_variation.clear();
+    }
+
+    void count_node() {
+        nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void update_principal_variation(int ply, Move move) {
+        principal_variation[ply][ply] = move;
+        for (int i = ply + 1; i < principal_variation_length[ply + 1]; ++i)
+            principal_variation[ply][i] = principal_variation[ply + 1][i];
+        principal_variation_length[ply] = std::max(principal_variation_length[ply + 1], ply + 1);
+    }
+};
+
+Search::Search(std::size_t hash_size_in_megabytes)
+    : m_table(hash_size_in_megabytes) {
+    set_thread_count(1);
+}
+
+Search::~Search() = default;
+
+void Search::set_thread_count(int thread_count) {
+    m_workers.resize(std::max(thread_count, 1));
+    for (std::size_t i = 0; i < m_workers.size(); ++i) {
+        if (!m_workers[i])
+            m_workers[i] = std::make_unique<Worker>();
+        m_workers[i]->index = static_cast<int>(i);
+    }
+}
+
+void Search::stop() {
+    m_stop_requested.store(true, std::memory_order_relaxed);
+}
+
+bool Search::should_stop(Worker& worker) {
+    if (m_stop_requested.load(std::memory_order_relaxed))
+        return true;
+    // Reading the clock and the other threads' counters is comparatively slow, so it is only done every so often.
+    if (!m_may_stop.load(std::memory_order_relaxed) || (worker.nodes.load(std::memory_order_relaxed) & 1023) != 0)
+        return false;
+    std::uint64_t nodes = 0;
+    for (const auto& other : m_workers)
+        nodes += other->nodes.load(std::memory_order_relaxed);
+    if ((m_limits.nodes > 0 && nodes >= m_limits.nodes)
+        || (m_limits.time.count() > 0 && std::chrono::steady_clock::now() - m_start >= m_limits.time)) {
+        stop();
+        return true;
+    }
+    return false;
+}
+
+void Search::order_moves(const Worker& worker, const GameState& game, MoveList& moves, int ply, Move hash_move) const {
+    const auto& board = game.get_board();
+    const auto player = static_cast<int>(game.get_current_player());
+    std::array<int, MoveList::capacity> scores;
+    for (int i = 0; i < moves.size(); ++i) {
+        const auto& move = moves[i];
+        const auto origin = move.origin();
+        const auto destination = move.destination();
+        const auto piece = static_cast<int>(board[origin.x][origin.y].piece().value());
+        int score = 0;
+        if (move == hash_move) {
+            score = 1 << 30;
+        } else if (move.has_flag(Move::Capture)) {
+            // Most valuable victim first, then least valuable attacker, but captures that lose material once the other
+            // players have recaptured only come after the killer moves. Taking a piece worth at least as much as the one
+            // taking it never loses anything, and neither does a king, which only ever moves onto squares nobody attacks,
+            // so only the other captures need a closer look.
+            const auto victim = move.has_flag(Move::EnPassant) ? Piece::Pawn : board[destination.x][destination.y].piece().value();
+            const bool is_safe = s_piece_values[static_cast<int>(victim)] >= s_piece_values[piece] || piece == static_cast<int>(Piece::King);
+            const int exchange = is_safe ? 0 : game.static_exchange(destination, move);
+            if (exchange >= 0)
+                score = (1 << 28) + s_piece_values[static_cast<int>(victim)] * 8 - s_piece_values[piece] / 100;
+            else
+                score = (1 << 25) + exchange;
+        } else if (move.promotion().has_value()) {
+            score = (1 << 27) + s_piece_values[static_cast<int>(move.promotion().value())];
+        } else if (move == worker.killers[ply][0]) {
+            score = (1 << 26) + 1;
+        } else if (move == worker.killers[ply][1]) {
+            score = 1 << 26;
+        } else {
+            score = worker.history[player][piece][move.destination_index()];
+        }
+        scores[i] = score;
+    }
+
+    // Insertion sort, as move lists are short and often nearly sorted already.
+    for (int i = 1; i < moves.size(); ++i) {
+        const auto move = moves[i];
+        const int score = scores[i];
+        int j = i;
+        for (; j > 0 && scores[j - 1] < score; --j) {
+            moves[j] = moves[j - 1];
+            scores[j] = scores[j - 1];
+        }
+        moves[j] = move;
+        scores[j] = score;
+    }
+}
+
+void Search::record_cutoff(Worker& worker, const GameState& game, Move move, int depth, int ply) const {
+    if (!is_quiet(move))
+        return;
+    if (worker.killers[ply][0] != move) {
+        worker.killers[ply][1] = worker.killers[ply][0];
+        worker.killers[ply][0] = move;
+    }
+    const auto origin = move.origin();
+    const auto piece = static_cast<int>(game.get_board()[origin.x][origin.y].piece().value());
+    auto& history = worker.history[static_cast<int>(game.get_current_player())][piece][move.destination_index()];
+    history = std::min(history + depth * depth, 1 << 20);
+}
+
+// Returns the root player's score. The root player maximizes it and every other player minimizes it.
+int Search::paranoid(Worker& worker, const GameState& game, int depth, int ply, int alpha, int beta) {
+    worker.count_node();
+    worker.principal_variation_length[ply] = ply;
+    if (should_stop(worker))
+        return 0;
+    if (depth == 0 || game.get_current_players().size() <= 1 || !game.player_exists(m_root_player) || ply == max_ply - 1)
+        return evaluate(game)[static_cast<int>(m_root_player)];
+
+    const auto key = game.get_hash() ^ s_paranoid_keys[static_cast<int>(m_root_player)];
+    Move hash_move {};
+    if (const auto entry = m_table.probe(key)) {
+        hash_move = entry->best_move;
+        const int score = entry->scores[static_cast<int>(m_root_player)];
+        if (ply > 0 && entry->depth >= depth
+            && (entry->bound == Bound::Exact || (entry->bound == Bound::Lower && score >= beta) || (entry->bound == Bound::Upper && score <= alpha)))
+            return score;
+    }
+
+    MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    order_moves(worker, game, moves, ply, hash_move);
+
+    const bool maximizing = game.get_current_player() == m_root_player;
+    const int original_alpha = alpha;
+    const int original_beta = beta;
+    int best_score = maximizing ? -1 : max_score + 1;
+    Move best_move {};
+    for (const auto& move : moves) {
+        // Turns cannot be taken back, as they may eliminate players, so each child gets its own copy.
+        auto child = game;
+        child.make_move(move);
+        child.advance_turn();
+        const int score = paranoid(worker, child, depth - 1, ply + 1, alpha, beta);
+        if (m_stop_requested.load(std::memory_order_relaxed))
+            return 0;
+
+        if (maximizing ? score > best_score : score < best_score) {
+            best_score = score;
+            best_move = move;
+            worker.update_principal_variation(ply, move);
+        }
+        if (maximizing)
+            alpha = std::max(alpha, score);
+        else
+            beta = std::min(beta, score);
+        if (alpha >= beta) {
+            record_cutoff(worker, game, move, depth, ply);
+            break;
+        }
+    }
+
+    TranspositionEntry entry {};
+    entry.scores[static_cast<int>(m_root_player)] = best_score;
+    entry.best_move = best_move;
+    entry.depth = depth;
+    entry.bound = best_score <= original_alpha ? Bound::Upper : best_score >= original_beta ? Bound::Lower : Bound::Exact;
+    m_table.store(key, entry);
+    return best_score;
+}
+
+// Returns every player's score, each of which is maximized by its own player. 'parent_best' is the best score the player who
+// moved into this position has found so far, or -1 if there is none. Once the player to move here is sure to get more than
+// what remains of 'max_score', the parent cannot do better through this position and the rest of its moves are skipped.
+std::array<int, 4> Search::max_n(Worker& worker, const GameState& game, int depth, int ply, int parent_best) {
+    worker.count_node();
+    worker.principal_variation_length[ply] = ply;
+    if (should_stop(worker))
+        return {};
+    if (depth == 0 || game.get_current_players().size() <= 1 || ply == max_ply - 1)
+        return evaluate(game);
+
+    const auto key = game.get_hash();
+    Move hash_move {};
+    if (const auto entry = m_table.probe(key)) {
+        hash_move = entry->best_move;
+        // Pruned results are never stored, so every entry is exact.
+        if (ply > 0 && entry->depth >= depth)
+            return entry->scores;
+    }
+
+    MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    order_moves(worker, game, moves, ply, hash_move);
+
+    const auto player = static_cast<int>(game.get_current_player());
+    std::array<int, 4> best_scores {};
+    best_scores[player] = -1;
+    Move best_move {};
+    for (const auto& move : moves) {
+        auto child = game;
+        child.make_move(move);
+        child.advance_turn();
+        const auto scores = max_n(worker, child, depth - 1, ply + 1, best_scores[player]);
+        if (m_stop_requested.load(std::memory_order_relaxed))
+            return {};
+
+        if (scores[player] > best_scores[player]) {
+            best_scores = scores;
+            best_move = move;
+            worker.update_principal_variation(ply, move);
+        }
+        if (parent_best >= 0 && best_scores[player] >= max_score - parent_best) {
+            record_cutoff(worker, game, move, depth, ply);
+            return best_scores;
+        }
+    }
+
+    TranspositionEntry entry {};
+    entry.scores = best_scores;
+    entry.best_move = best_move;
+    entry.depth = depth;
+    m_table.store(key, entry);
+    return best_scores;
+}
+
+void Search::iterative_deepening(Worker& worker, const GameState& game) {
+    // Every other helper thread starts a ply deeper, so that the threads are spread over two depths at any time.
+    for (int depth = 1 + worker.index % 2; depth <= m_max_depth; ++depth) {
+        int score = 0;
+        if (m_algorithm == SearchAlgorithm::Paranoid)
+            score = paranoid(worker, game, depth, 0, -1, max_score + 1);
+        else
+            score = max_n(worker, game, depth, 0, -1)[static_cast<int>(m_root_player)];
+        if (m_stop_requested.load(std::memory_order_relaxed))
+            break;
+
+        worker.completed_depth = depth;
+        worker.score = score;
+        worker.completed_principal_variation.assign(worker.principal_variation[0].begin(), worker.principal_variation[0].begin() + worker.principal_variation_length[0]);
+        if (worker.index != 0)
+            continue;
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start);
+        if (m_iteration_callback) {
+            SearchResult result {};
+            result.best_move = worker.completed_principal_variation.empty() ? Move {} : worker.completed_principal_variation.front();
+            result.score = score;
+            result.depth = depth;
+            for (const auto& other : m_workers)
+                result.nodes += other->nodes.load(std::memory_order_relaxed);
+            result.time = elapsed;
+            result.principal_variation = worker.completed_principal_variation;
+            m_iteration_callback(result);
+        }
+
+        // Only the first iteration is guaranteed to complete, so that there is always a searched move to return.
+        m_may_stop.store(true, std::memory_order_relaxed);
+        // The next iteration takes several times as long as this one, so it would most likely be cut off anyway.
+        if (m_limits.time.count() > 0 && elapsed * 2 >= m_limits.time)
+            break;
+    }
+}
+
+SearchResult Search::run(const GameState& game, const SearchLimits& limits) {
+    m_start = std::chrono::steady_clock::now();
+    m_limits = limits;
+    m_max_depth = limits.depth > 0 ? std::min(limits.depth, max_ply - 1) : max_ply - 1;
+    m_stop_requested.store(false, std::memory_order_relaxed);
+    m_may_stop.store(false, std::memory_order_relaxed);
+    m_root_player = game.get_current_player();
+    m_table.new_search();
+    for (auto& worker : m_workers)
+        worker->reset();
+
+    SearchResult result {};
+    if (game.get_current_players().size() <= 1)
+        return result;
+    MoveList root_moves;
+    game.generate_legal_moves(m_root_player, root_moves);
+    if (root_moves.empty())
+        return result;
+
+    auto bind = [this](int index) {
+#ifdef __linux__
+        if (!m_cores.empty())
+            return std::optional<cpu_set_t>(bind_to_core(m_cores[index % m_cores.size()]));
+        return std::optional<cpu_set_t>();
+#else
+        (void)index;
+        return std::optional<int>();
+#endif
+    };
+
+    std::vector<std::thread> helpers;
+    for (std::size_t i = 1; i < m_workers.size(); ++i) {
+        helpers.emplace_back([this, &game, &bind, i] {
+            bind(static_cast<int>(i));
+            iterative_deepening(*m_workers[i], game);
+        });
+    }
+    const auto previous_cores = bind(0);
+    iterative_deepening(*m_workers[0], game);
+    stop();
+    for (auto& helper : helpers)
+        helper.join();
+#ifdef __linux__
+    if (previous_cores.has_value())
+        pthread_setaffinity_np(pthread_self(), sizeof(previous_cores.value()), &previous_cores.value());
+#endif
+
+    // Take the deepest completed iteration of any thread, preferring lower thread indices, so that the outcome only depends
+    // on what each thread found and not on the order in which they finished.
+    const Worker* best = m_workers[0].get();
+    for (const auto& worker : m_workers) {
+        if (worker->completed_depth > best->completed_depth)
+            best = worker.get();
+    }
+    result.best_move = best->completed_principal_variation.empty() ? root_moves[0] : best->completed_principal_variation.front();
+    result.score = best->score;
+    result.depth = best->completed_depth;
+    result.principal_variation = best->completed_principal_variation;
+    for (const auto& worker : m_workers) {
+        result.thread_nodes.push_back(worker->nodes.load(std::memory_order_relaxed));
+        result.nodes += result.thread_nodes.back();
+    }
+    result.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start);
+    return result;
+}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "library.h"
+#include "transposition_table.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace FPC {
+
+enum class SearchAlgorithm {
+    Paranoid, // The player to move assumes that everyone else has teamed up against them, which allows alpha-beta pruning.
+    MaxN,     // Every player maximizes their own score, and only shallow pruning is possible.
+};
+
+// A search stops at whichever limit it reaches first. A limit of zero means no limit.
+struct SearchLimits {
+    int depth = 0; // In plies, where every turn of every player is one ply.
+    std::uint64_t nodes = 0;
+    std::chrono::milliseconds time {0};
+};
+
+struct SearchResult {
+    Move best_move {};
+    // The share of the game the player to move can expect, from 0 (eliminated) to 'Search::max_score' (won).
+    int score = 0;
+    int depth = 0;
+    std::uint64_t nodes = 0;
+    std::chrono::milliseconds time {0};
+    std::vector<Move> principal_variation;
+    // How many nodes each search thread visited, the thread running the search first.
+    std::vector<std::uint64_t> thread_nodes;
+};
+
+// Every remaining player's share of 'Search::max_score', in proportion to the sum of their terms in 'GameState::get_evaluator',
+// or to their output of the game's network if it has one, indexed by color. Once the game is over, the winner gets all of it.
+std::array<int, 4> evaluate(const GameState& game);
+
+// Chooses a move by iterative deepening. Scores are shares of the game: every remaining player gets a share of
+// 'max_score' in proportion to their evaluation, a player who has been eliminated gets nothing and the winner gets everything.
+// As the shares never add up to more than 'max_score', max-n search can prune without knowing the rest of the tree.
+//
+// With more than one thread, the extra threads search the same position at the same time (lazy SMP). They only share the
+// transposition table, and every other one starts a ply deeper, so that they keep filling in entries the others need next.
+class Search {
+public:
+    static constexpr int max_score = 1000;
+    static constexpr int max_ply = 64;
+
+    explicit Search(std::size_t hash_size_in_megabytes = 16);
+    ~Search();
+
+    Search(const Search&) = delete;
+    Search& operator=(const Search&) = delete;
+
+    // Always returns a legal move if the player to move has one, even if the limits are too tight to complete a single iteration.
+    SearchResult run(const GameState& game, const SearchLimits& limits);
+    // May be called from any thread to make a running search return as soon as possible.
+    void stop();
+
+    void set_algorithm(SearchAlgorithm algorithm) { m_algorithm = algorithm; }
+    SearchAlgorithm get_algorithm() const { return m_algorithm; }
+    // The thread calling 'run' searches as well, so a count of one means no additional threads.
+    void set_thread_count(int thread_count);
+    int get_thread_count() const { return static_cast<int>(m_workers.size()); }
+    // Binds the n-th search thread to the n-th listed core, wrapping around if there are more threads than cores, or lets
+    // the threads run anywhere if the list is empty. Only supported on Linux.
+    void set_thread_affinity(std::vector<int> cores) { m_cores = std::move(cores); }
+    // Called after every completed iteration, on the thread running the search.
+    void set_iteration_callback(std::function<void(const SearchResult&)> callback) { m_iteration_callback = std::move(callback); }
+    TranspositionTable& get_transposition_table() { return m_table; }
+
+private:
+    struct Worker;
+
+    void iterative_deepening(Worker& worker, const GameState& game);
+    int paranoid(Worker& worker, const GameState& game, int depth, int ply, int alpha, int beta);
+    std::array<int, 4> max_n(Worker& worker, const GameState& game, int depth, int ply, int parent_best);
+    void order_moves(const Worker& worker, const GameState& game, MoveList& moves, int ply, Move hash_move) const;
+    void record_cutoff(Worker& worker, const GameState& game, Move move, int depth, int ply) const;
+    bool should_stop(Worker& worker);
+
+    TranspositionTable m_table;
+    SearchAlgorithm m_algorithm = SearchAlgorithm::Paranoid;
+    std::function<void(const SearchResult&)> m_iteration_callback;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<int> m_cores;
+
+    // State of the running search. Apart from the two flags, it is only written before the other search threads start.
+    std::atomic<bool> m_stop_requested {false};
+    std::atomic<bool> m_may_stop {false};
+    Color m_root_player = Color::Red;
+    SearchLimits m_limits;
+    int m_max_depth = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+}
@@ -0,0 +1,202 @@
+#include "bots.h"
+#include "game_database.h"
+#include "library.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void print_usage() {
+    std::cout << "Usage: selfplay [--games <count>] [--bots <bot>,...] [--threads <count>] [--seed <seed>] [--ply-limit <plies>]\n"
+              << "                [--depth <plies>] [--nodes <count>] [--hash <megabytes>] [--output <file>]\n"
+              << "Plays up to a million games between one to four bots ('random', 'greedy' or 'search'), all at once on every core\n"
+              << "unless --threads is given, and prints how often each bot won and was eliminated. The n-th game of a run seats the bots\n"
+              << "from the (n mod 4)-th color on, repeating the list as needed, so that every bot gets every seat. Defaults to 100 games\n"
+              << "of greedy against random.\n"
+              << "Search bots look --depth plies (2 by default) or --nodes nodes ahead. Games are abandoned after --ply-limit plies (1000\n"
+              << "by default), and with --output, all of them are appended to a game database (see 'games').\n";
+}
+
+// Every game is kept in memory until the run is over.
+constexpr unsigned long long s_max_games = 1000000;
+
+struct GameResult {
+    std::vector<FPC::Move> moves;
+    FPC::GameOutcome outcome;
+    std::array<int, 4> seats {}; // The index of the bot playing each color.
+};
+
+struct Statistics {
+    int seats = 0;
+    int wins = 0;
+    std::array<int, 3> eliminations {}; // How often the player was the first, second and third to be eliminated.
+};
+
+static void print_statistics(const std::string& title, const std::vector<std::string>& names, const std::vector<Statistics>& statistics) {
+    std::cout << '\n'
+              << std::left << std::setw(10) << title << std::right << std::setw(8) << "Seats" << std::setw(8) << "Wins" << std::setw(10) << "Out 1st"
+              << std::setw(10) << "Out 2nd" << std::setw(10) << "Out 3rd" << '\n';
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        const auto& entry = statistics[i];
+        std::cout << std::left << std::setw(10) << names[i] << std::right << std::setw(8) << entry.seats << std::setw(8) << entry.wins;
+        for (const auto count : entry.eliminations)
+            std::cout << std::setw(10) << count;
+        std::cout << '\n';
+    }
+}
+
+int main(int argc, char** argv) {
+    int game_count = 100;
+    std::vector<std::string> bot_names {"greedy", "random"};
+    unsigned thread_count = std::thread::hardware_concurrency();
+    std::uint64_t seed = 0;
+    std::size_t ply_limit = 1000;
+    FPC::SearchLimits search_limits;
+    std::size_t hash_megabytes = 4;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if ((argument == "--games" || argument == "--threads" || argument == "--seed" || argument == "--ply-limit" || argument == "--depth"
+                || argument == "--nodes" || argument == "--hash")
+            && i + 1 < argc) {
+            try {
+                const auto value = std::stoull(argv[++i]);
+                if (argument == "--games" && value > s_max_games)
+                    throw std::out_of_range("too many games");
+                if (argument == "--games")
+                    game_count = static_cast<int>(value);
+                else if (argument == "--threads")
+                    thread_count = static_cast<unsigned>(value);
+                else if (argument == "--seed")
+                    seed = value;
+                else if (argument == "--ply-limit")
+                    ply_limit = value;
+                else if (argument == "--depth")
+                    search_limits.depth = static_cast<int>(value);
+                else if (argument == "--nodes")
+                    search_limits.nodes = value;
+                else
+                    hash_megabytes = value;
+            } catch (const std::exception&) {
+                print_usage();
+                return 1;
+            }
+        } else if (argument == "--bots" && i + 1 < argc) {
+            // Split by hand rather than with 'std::getline', which would drop a trailing empty name.
+            bot_names.clear();
+            const std::string list = argv[++i];
+            for (std::size_t start = 0; !list.empty() && start <= list.size();) {
+                const auto end = std::min(list.find(',', start), list.size());
+                bot_names.push_back(list.substr(start, end - start));
+                start = end + 1;
+            }
+        } else if (argument == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (search_limits.depth == 0 && search_limits.nodes == 0)
+        search_limits.depth = 2;
+    if (bot_names.empty() || bot_names.size() > 4) {
+        print_usage();
+        return 1;
+    }
+    for (const auto& name : bot_names) {
+        if (name.empty() || !FPC::make_bot(name, search_limits, 1)) {
+            print_usage();
+            return 1;
+        }
+    }
+    thread_count = std::max(thread_count, 1u);
+
+    FPC::GameDatabaseWriter writer;
+    if (!output_path.empty() && !writer.open(output_path)) {
+        std::cout << "Cannot open " << output_path << " for writing.\n";
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<GameResult> results(game_count);
+    {
+        FPC::ThreadPool pool(thread_count);
+        // Every worker thread gets its own bots, and plays one whole game at a time with them.
+        std::vector<std::vector<std::unique_ptr<FPC::Bot>>> worker_bots(pool.get_thread_count());
+        for (int i = 0; i < game_count; ++i) {
+            pool.submit([&, i] {
+                auto& bots = worker_bots[pool.get_current_worker_index()];
+                if (bots.empty()) {
+                    for (const auto& name : bot_names)
+                        bots.push_back(FPC::make_bot(name, search_limits, hash_megabytes));
+                }
+                for (std::size_t bot = 0; bot < bots.size(); ++bot)
+                    bots[bot]->new_game(seed ^ (0x9e3779b97f4a7c15 * (static_cast<std::uint64_t>(i) * bots.size() + bot + 1)));
+
+                auto& result = results[i];
+                for (int color = 0; color < 4; ++color)
+                    result.seats[color] = (color + i) % static_cast<int>(bots.size());
+                FPC::GameState game;
+                FPC::MoveList moves;
+                game.generate_legal_moves(game.get_current_player(), moves);
+                FPC::EliminationTracker tracker;
+                while (game.get_current_players().size() > 1 && result.moves.size() < ply_limit) {
+                    const auto move = bots[result.seats[static_cast<int>(game.get_current_player())]]->choose_move(game, moves);
+                    game.make_move(move);
+                    game.advance_turn(moves);
+                    tracker.update(game);
+                    result.moves.push_back(move);
+                }
+                result.outcome = tracker.get_outcome();
+            });
+        }
+        pool.wait_idle();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::uint64_t plies = 0;
+    int abandoned_games = 0;
+    std::vector<Statistics> bot_statistics(bot_names.size());
+    std::vector<Statistics> color_statistics(4);
+    for (const auto& result : results) {
+        plies += result.moves.size();
+        const auto winner = result.outcome.get_winner();
+        if (!winner.has_value())
+            ++abandoned_games;
+        for (int color = 0; color < 4; ++color) {
+            ++bot_statistics[result.seats[color]].seats;
+            ++color_statistics[color].seats;
+        }
+        if (winner.has_value()) {
+            ++bot_statistics[result.seats[static_cast<int>(winner.value())]].wins;
+            ++color_statistics[static_cast<int>(winner.value())].wins;
+        }
+        for (std::size_t order = 0; order < result.outcome.eliminated.size(); ++order) {
+            const auto color = static_cast<int>(result.outcome.eliminated[order]);
+            ++bot_statistics[result.seats[color]].eliminations[order];
+            ++color_statistics[color].eliminations[order];
+        }
+        if (!output_path.empty() && !writer.add_game(result.moves, result.outcome)) {
+            std::cout << "Cannot write to " << output_path << ".\n";
+            return 1;
+        }
+    }
+    if (!output_path.empty() && !writer.close()) {
+        std::cout << "Cannot write to " << output_path << ".\n";
+        return 1;
+    }
+
+    std::cout << "Games: " << game_count << " (" << abandoned_games << " abandoned)\n"
+              << "Time: " << static_cast<std::uint64_t>(elapsed.count() * 1000) << " ms\n"
+              << "Games per second: " << std::fixed << std::setprecision(2) << game_count / std::max(elapsed.count(), 1e-9) << '\n'
+              << "Plies per second: " << static_cast<std::uint64_t>(plies / std::max(elapsed.count(), 1e-9)) << '\n'
+              << "Average plies: " << std::setprecision(1) << static_cast<double>(plies) / std::max(game_count, 1) << '\n';
+    print_statistics("Bot", bot_names, bot_statistics);
+    print_statistics("Color", {"red", "blue", "yellow", "green"}, color_statistics);
+    return 0;
+}
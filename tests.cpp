@@ -0,0 +1,389 @@
+#include "game_database.h"
+#include "library.h"
+#include "nnue.h"
+#include "transposition_table.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Checks behaviour that perft and the tools do not cover on their own. Prints every failed check and exits with 1 if any
+// failed.
+
+static int s_failures = 0;
+
+static void expect(bool condition, const std::string& description) {
+    if (condition)
+        return;
+    std::cout << "FAILED: " << description << '\n';
+    ++s_failures;
+}
+
+static void test_always_replace_fills_both_slots() {
+    // Zero megabytes makes a single bucket, which every key maps to.
+    FPC::TranspositionTable table(0, FPC::ReplacementPolicy::AlwaysReplace);
+    FPC::TranspositionEntry entry {};
+    entry.depth = 5;
+    entry.scores = {1, 2, 3, 4};
+    table.store(1, entry);
+    entry.depth = 3;
+    entry.scores = {5, 6, 7, 8};
+    table.store(2, entry);
+    const auto first = table.probe(1);
+    const auto second = table.probe(2);
+    expect(first.has_value() && first->scores[0] == 1, "AlwaysReplace keeps the first of two keys in one bucket");
+    expect(second.has_value() && second->scores[0] == 5, "AlwaysReplace keeps the second of two keys in one bucket");
+
+    table.store(3, entry);
+    expect(table.probe(3).has_value(), "AlwaysReplace stores a new key into a full bucket");
+    expect(table.probe(1).has_value() && !table.probe(2).has_value(), "AlwaysReplace evicts the shallower entry of a full bucket");
+
+    // Once a new search starts, even the deeper entry is evicted ahead of one stored during it.
+    table.new_search();
+    entry.depth = 1;
+    table.store(4, entry);
+    table.store(5, entry);
+    expect(table.probe(4).has_value() && table.probe(5).has_value(), "AlwaysReplace evicts entries from older searches first");
+}
+
+static bool has_legal_move(const FPC::GameState& game, const std::string& text) {
+    FPC::MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    for (const auto& move : moves) {
+        if (FPC::move_to_string(move) == text)
+            return true;
+    }
+    return false;
+}
+
+static void test_en_passant_needs_the_skipped_square() {
+    // Yellow's pawn on f11 jumped over f12, so Red's pawn on e11 may take it there. Blue's pawn on d9 jumped along the rank
+    // from b9 and never crossed d10, so Red's pawn on e9 may not take it on d10.
+    FPC::GameState game;
+    const bool is_parsed = FPC::parse_position(game, "6yK7/14/14/4rPyP8/14/3bPrP9/13gK/bK13/14/14/14/14/14/7rK6 r rbyg - d9,f11");
+    expect(is_parsed, "The en passant test position parses");
+    if (!is_parsed)
+        return;
+    expect(has_legal_move(game, "e11f12"), "A pawn that jumped over the target square can be taken en passant");
+    expect(!has_legal_move(game, "e9d10"), "A pawn that jumped across the capturer's path cannot be taken en passant");
+}
+
+// The four kings on their starting squares plus the given pieces, with Red to move and the players in 'remaining_players'.
+static FPC::GameState make_position(std::initializer_list<std::pair<const char*, FPC::Square>> pieces, int remaining_players = 0xf) {
+    std::array<std::array<FPC::Square, 14>, 14> board {};
+    board[7][13] = FPC::Square(FPC::Piece::King, FPC::Color::Red);
+    board[0][6] = FPC::Square(FPC::Piece::King, FPC::Color::Blue);
+    board[6][0] = FPC::Square(FPC::Piece::King, FPC::Color::Yellow);
+    board[13][7] = FPC::Square(FPC::Piece::King, FPC::Color::Green);
+    for (const auto& [name, square] : pieces) {
+        // Files 'a' to 'n' from the left and ranks 1 to 14 from Red's side, as in moves.
+        board[name[0] - 'a'][14 - std::stoi(name + 1)] = square;
+    }
+    FPC::GameState game;
+    expect(game.set_position(board, FPC::Color::Red, remaining_players, 0), "The test position is valid");
+    return game;
+}
+
+static void expect_exchange(const FPC::GameState& game, const char* move_text, int expected, const std::string& description) {
+    const auto move = FPC::parse_move(game, move_text);
+    expect(move.has_value(), description + ": " + move_text + " is legal");
+    if (!move.has_value())
+        return;
+    const int exchange = game.static_exchange(move->destination(), move.value());
+    expect(exchange == expected, description + ": expected " + std::to_string(expected) + ", got " + std::to_string(exchange));
+}
+
+static void test_static_exchange() {
+    using FPC::Color;
+    using FPC::Piece;
+    using FPC::Square;
+    expect_exchange(make_position({{"e4", Square(Piece::Rook, Color::Red)}, {"e10", Square(Piece::Knight, Color::Yellow)}}), "e4e10", 300,
+        "Static exchange of an undefended capture");
+    expect_exchange(make_position({{"e4", Square(Piece::Rook, Color::Red)}, {"e10", Square(Piece::Knight, Color::Yellow)}, {"f11", Square(Piece::Pawn, Color::Yellow)}}),
+        "e4e10", -200, "Static exchange of a defended capture");
+    // The rook behind the first one recaptures through it, which makes taking the pawn back cost Yellow their pawn.
+    expect_exchange(make_position({{"e4", Square(Piece::Rook, Color::Red)}, {"e3", Square(Piece::Rook, Color::Red)}, {"e10", Square(Piece::Knight, Color::Yellow)},
+                        {"f11", Square(Piece::Pawn, Color::Yellow)}}),
+        "e4e10", -100, "Static exchange with an x-ray recapture");
+    expect_exchange(make_position({{"g2", Square(Piece::Knight, Color::Yellow)}}), "h1g2", 300, "Static exchange of a capture by a king");
+    // Yellow's king stands in Red's line of fire, as it may once another player has moved, and nothing can take back.
+    expect_exchange(make_position({{"e4", Square(Piece::Rook, Color::Red)}, {"g14", Square()}, {"e14", Square(Piece::King, Color::Yellow)}}), "e4e14", 10000,
+        "Static exchange of a capture of a king");
+    // Green, not Yellow, takes the rook back, as nothing of Yellow's defends the knight.
+    expect_exchange(make_position({{"e4", Square(Piece::Rook, Color::Red)}, {"e10", Square(Piece::Knight, Color::Yellow)}, {"l10", Square(Piece::Rook, Color::Green)}}),
+        "e4e10", -200, "Static exchange with a third color recapturing");
+    // Once Yellow is out, their pieces are worth nothing and never take back.
+    expect_exchange(make_position({{"e4", Square(Piece::Rook, Color::Red)}, {"e10", Square(Piece::Knight, Color::Yellow)}, {"f11", Square(Piece::Pawn, Color::Yellow)}}, 0xb),
+        "e4e10", 0, "Static exchange against an eliminated player");
+}
+
+// Calls 'visit' with every position of random games played one after another, 'count' positions in all.
+template<typename Visit>
+static void for_random_positions(int count, std::uint64_t seed, Visit visit) {
+    std::uint64_t state = seed | 1;
+    FPC::GameState game;
+    FPC::MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    for (int i = 0, plies = 0; i < count; ++i, ++plies) {
+        if (game.get_current_players().size() <= 1 || moves.empty() || plies == 400) {
+            game.reset();
+            moves.clear();
+            game.generate_legal_moves(game.get_current_player(), moves);
+            plies = 0;
+        }
+        visit(game);
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        game.make_move(moves[static_cast<int>(((state * 0x2545f4914f6cdd1d) >> 32) % moves.size())]);
+        game.advance_turn(moves);
+    }
+}
+
+static void test_position_round_trips() {
+    int text_failures = 0;
+    int packed_failures = 0;
+    for_random_positions(20000, 1, [&](const FPC::GameState& game) {
+        const auto text = FPC::position_to_string(game);
+        FPC::GameState parsed;
+        if (!FPC::parse_position(parsed, text) || parsed.get_hash() != game.get_hash() || FPC::position_to_string(parsed) != text)
+            ++text_failures;
+        const auto packed = FPC::pack_position(game);
+        FPC::GameState unpacked;
+        if (!FPC::unpack_position(unpacked, packed) || unpacked.get_hash() != game.get_hash() || FPC::pack_position(unpacked) != packed)
+            ++packed_failures;
+    });
+    expect(text_failures == 0, std::to_string(text_failures) + " positions did not survive being written and parsed");
+    expect(packed_failures == 0, std::to_string(packed_failures) + " positions did not survive being packed and unpacked");
+}
+
+static void test_malformed_positions() {
+    const std::string initial = "3yRyNyByKyQyByNyR3/3yPyPyPyPyPyPyPyP3/14/bRbP10gPgR/bNbP10gPgN/bBbP10gPgB/bKbP10gPgQ/bQbP10gPgK/bBbP10gPgB/"
+                                "bNbP10gPgN/bRbP10gPgR/14/3rPrPrPrPrPrPrPrP3/3rRrNrBrQrKrBrNrR3";
+    FPC::GameState game;
+    expect(FPC::parse_position(game, initial + " r rbyg rKQbKQyKQgKQ -"), "The initial position parses");
+    expect(game.get_hash() == FPC::GameState().get_hash(), "The initial position parses to the initial position");
+
+    const std::array<std::string, 12> malformed {
+        "",
+        initial,
+        initial + " r rbyg rKQbKQyKQgKQ",
+        initial + " x rbyg rKQbKQyKQgKQ -",
+        initial + " r rbyx rKQbKQyKQgKQ -",
+        initial + " b ryg rKQbKQyKQgKQ -",
+        initial + " r rbyg rZ -",
+        initial + " r rbyg rKQbKQyKQgKQ h2",
+        initial + " r rbyg rKQbKQyKQgKQ - extra",
+        "rK2yRyNyByKyQyByNyR3/3yPyPyPyPyPyPyPyP3/14/bRbP10gPgR/bNbP10gPgN/bBbP10gPgB/bKbP10gPgQ/bQbP10gPgK/bBbP10gPgB/bNbP10gPgN/bRbP10gPgR/14/"
+        "3rPrPrPrPrPrPrPrP3/3rRrNrBrQrKrBrNrR3 r rbyg - -",
+        "4yRyNyByKyQyByNyR3/3yPyPyPyPyPyPyPyP3/14/bRbP10gPgR/bNbP10gPgN/bBbP10gPgB/bKbP10gPgQ/bQbP10gPgK/bBbP10gPgB/bNbP10gPgN/bRbP10gPgR/14/"
+        "3rPrPrPrPrPrPrPrP3/3rRrNrBrQrKrBrNrR3 r rbyg - -",
+        "14/14/14/14/14/14/14/14/14/14/14/14/14/14 r rbyg - -",
+    };
+    // A failed parse leaves the position as it was, so it is checked against a position other than the initial one.
+    FPC::GameState played;
+    played.make_move(FPC::parse_move(played, "h2h4").value());
+    played.advance_turn();
+    for (const auto& text : malformed) {
+        auto copy = played;
+        expect(!FPC::parse_position(copy, text), "Malformed position is rejected: \"" + text + "\"");
+        expect(copy.get_hash() == played.get_hash(), "Malformed position leaves the game as it was: \"" + text + "\"");
+    }
+
+    FPC::PackedPosition garbage;
+    garbage.fill(0xff);
+    auto copy = played;
+    expect(!FPC::unpack_position(copy, garbage) && copy.get_hash() == played.get_hash(), "Malformed packed position is rejected");
+}
+
+struct PlayedGame {
+    std::vector<FPC::Move> moves;
+    FPC::GameOutcome outcome;
+    std::uint64_t final_hash = 0;
+};
+
+// A random game from the initial position, played until one player is left or 'ply_limit' plies have been played.
+static PlayedGame play_random_game(std::uint64_t seed, std::size_t ply_limit) {
+    PlayedGame played;
+    std::uint64_t state = seed | 1;
+    FPC::GameState game;
+    FPC::MoveList moves;
+    game.generate_legal_moves(game.get_current_player(), moves);
+    FPC::EliminationTracker tracker;
+    while (game.get_current_players().size() > 1 && !moves.empty() && played.moves.size() < ply_limit) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        const auto move = moves[static_cast<int>(((state * 0x2545f4914f6cdd1d) >> 32) % moves.size())];
+        game.make_move(move);
+        game.advance_turn(moves);
+        tracker.update(game);
+        played.moves.push_back(move);
+    }
+    played.outcome = tracker.get_outcome();
+    played.final_hash = game.get_hash();
+    return played;
+}
+
+static void expect_stored_game(const FPC::GameView& view, const PlayedGame& played, const std::string& description) {
+    expect(view.get_ply_count() == static_cast<int>(played.moves.size()), description + ": ply count");
+    expect(view.get_winner() == played.outcome.get_winner(), description + ": winner");
+    bool is_same_order = view.get_eliminated_count() == static_cast<int>(played.outcome.eliminated.size());
+    for (int order = 0; is_same_order && order < view.get_eliminated_count(); ++order)
+        is_same_order = view.get_eliminated(order) == played.outcome.eliminated[order];
+    expect(is_same_order, description + ": eliminated players");
+    std::size_t ply = 0;
+    const bool is_read = view.for_each_move([&](const FPC::Move& move) {
+        return ply < played.moves.size() && FPC::move_to_string(move) == FPC::move_to_string(played.moves[ply++]);
+    });
+    expect(is_read && ply == played.moves.size(), description + ": moves");
+    FPC::GameState game;
+    expect(view.replay(game, [](const FPC::GameState&) {}) && game.get_hash() == played.final_hash, description + ": replay ends in the same position");
+}
+
+static void test_game_database_round_trips() {
+    const auto path = (std::filesystem::temp_directory_path() / "fpc-tests.games").string();
+    std::remove(path.c_str());
+    std::vector<PlayedGame> games;
+    for (std::uint64_t seed = 1; seed <= 40; seed += 2)
+        games.push_back(play_random_game(seed, seed == 1 ? 0 : 2000));
+    // Random games hardly ever get down to one player, and the outcome is stored as it is given, so one is made up.
+    games[1].outcome.eliminated = {FPC::Color::Green, FPC::Color::Blue, FPC::Color::Red};
+
+    // The last game is added by a second writer, which has to keep the games already in the file.
+    FPC::GameDatabaseWriter writer;
+    bool is_written = writer.open(path);
+    for (std::size_t i = 0; i + 1 < games.size(); ++i)
+        is_written = is_written && writer.add_game(games[i].moves, games[i].outcome);
+    is_written = is_written && writer.close();
+    is_written = is_written && writer.open(path) && writer.add_game(games.back().moves, games.back().outcome) && writer.close();
+    expect(is_written, "The game database is written");
+
+    FPC::GameDatabase database;
+    const bool is_opened = database.open(path);
+    expect(is_opened && database.get_game_count() == games.size(), "The game database opens with every game in it");
+    if (is_opened && database.get_game_count() == games.size()) {
+        for (std::size_t i = 0; i < games.size(); ++i)
+            expect_stored_game(database.get_game(i), games[i], "Stored game " + std::to_string(i));
+    }
+    database.close();
+    std::remove(path.c_str());
+}
+
+// The weights of a network as saved, read one by one, to check the kernels against plain loops over them.
+class ReferenceNetwork {
+public:
+    explicit ReferenceNetwork(std::vector<std::uint8_t> file)
+        : m_file(std::move(file)) {
+    }
+
+    bool is_valid() const { return m_file.size() == weight_offset(FPC::Network::feature_count + 2, 0); }
+
+    int weight(int row, int column) const {
+        std::int16_t value;
+        std::memcpy(&value, m_file.data() + weight_offset(row, column), 2);
+        return value;
+    }
+
+    // Wraps around like the accumulators do.
+    FPC::Network::Accumulator accumulate(const std::vector<int>& features) const {
+        FPC::Network::Accumulator accumulator;
+        for (int i = 0; i < FPC::Network::hidden_size; ++i) {
+            int sum = weight(FPC::Network::feature_count, i);
+            for (const int feature : features)
+                sum += weight(feature, i);
+            accumulator[i] = static_cast<std::int16_t>(static_cast<std::uint16_t>(sum));
+        }
+        return accumulator;
+    }
+
+    int evaluate(const FPC::Network::Accumulator& accumulator) const {
+        std::int32_t bias;
+        std::memcpy(&bias, m_file.data() + 20, 4);
+        int sum = bias;
+        for (int i = 0; i < FPC::Network::hidden_size; ++i)
+            sum += std::clamp<int>(accumulator[i], 0, FPC::Network::activation_limit) * weight(FPC::Network::feature_count + 1, i);
+        return sum / FPC::Network::output_divisor;
+    }
+
+private:
+    // The feature weights come first, then the hidden biases and the output weights, as if they were two more features.
+    static std::size_t weight_offset(int row, int column) {
+        return FPC::NetworkFormat::header_size + 2 * (static_cast<std::size_t>(row) * FPC::Network::hidden_size + column);
+    }
+
+    std::vector<std::uint8_t> m_file;
+};
+
+static void test_network_matches_reference() {
+    FPC::Network network;
+    network.randomize(7);
+    const auto path = (std::filesystem::temp_directory_path() / "fpc-tests.nnue").string();
+    expect(network.save(path), "The network is saved");
+    std::ifstream file(path, std::ios::binary);
+    const ReferenceNetwork reference(std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), {}));
+    file.close();
+    std::remove(path.c_str());
+    expect(reference.is_valid(), "The saved network has the size of a network");
+    if (!reference.is_valid())
+        return;
+
+    std::string kernel_name = FPC::Network::get_kernel_name();
+    std::array<FPC::Network::Accumulator, 4> accumulators;
+    network.reset(accumulators);
+    const std::array<int, 4> first {0, 1, 777, 1234};
+    const std::array<int, 4> second {777, 2048, 3000, FPC::Network::feature_count - 1};
+    network.add_features(accumulators, first);
+    network.add_features(accumulators, second);
+    bool is_same = true;
+    for (int i = 0; i < 4; ++i)
+        is_same = is_same && accumulators[i] == reference.accumulate({first[i], second[i]});
+    expect(is_same, "The " + kernel_name + " kernels add features like the reference");
+    network.remove_features(accumulators, first);
+    network.remove_features(accumulators, second);
+    is_same = true;
+    for (int i = 0; i < 4; ++i)
+        is_same = is_same && accumulators[i] == reference.accumulate({});
+    expect(is_same, "The " + kernel_name + " kernels remove features like the reference");
+
+    // Values on both sides of the clipping range.
+    FPC::Network::Accumulator spread;
+    for (int i = 0; i < FPC::Network::hidden_size; ++i)
+        spread[i] = static_cast<std::int16_t>(i * 19 - 300);
+    expect(network.evaluate(spread) == reference.evaluate(spread), "The " + kernel_name + " kernels clip the accumulator like the reference");
+
+    int mismatches = 0;
+    for_random_positions(200, 3, [&](const FPC::GameState& position) {
+        auto game = position;
+        game.set_network(&network);
+        const auto from_scratch = game.compute_accumulators();
+        const auto outputs = game.evaluate_network();
+        for (int color = 0; color < 4; ++color)
+            mismatches += outputs[color] != reference.evaluate(from_scratch[color]);
+    });
+    expect(mismatches == 0, "The " + kernel_name + " kernels give " + std::to_string(mismatches) + " outputs unlike the reference");
+}
+
+int main() {
+    test_always_replace_fills_both_slots();
+    test_en_passant_needs_the_skipped_square();
+    test_static_exchange();
+    test_position_round_trips();
+    test_malformed_positions();
+    test_game_database_round_trips();
+    test_network_matches_reference();
+    if (s_failures > 0) {
+        std::cout << s_failures << " check(s) failed.\n";
+        return 1;
+    }
+    std::cout << "All checks passed.\n";
+    return 0;
+}
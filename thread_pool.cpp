@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace FPC {
+
+namespace {
+
+// Which pool the current thread works for, and at which index.
+thread_local const ThreadPool* s_current_pool = nullptr;
+thread_local int s_current_worker_index = -1;
+
+}
+
+ThreadPool::ThreadPool(unsigned thread_count) {
+    thread_count = std::max(thread_count, 1u);
+    for (unsigned i = 0; i < thread_count; ++i)
+        m_workers.push_back(std::make_unique<Worker>());
+    // Only start the threads once every queue exists, as they may start stealing right away.
+    for (unsigned i = 0; i < thread_count; ++i)
+        m_workers[i]->thread = std::thread([this, i] { run_worker(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    wait_idle();
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stopping = true;
+    }
+    m_work_available.notify_all();
+    for (auto& worker : m_workers)
+        worker->thread.join();
+}
+
+int ThreadPool::get_current_worker_index() const {
+    return s_current_pool == this ? s_current_worker_index : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int index = get_current_worker_index();
+    if (index < 0)
+        index = static_cast<int>(m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_workers.size());
+
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Sleeping workers check this under the same lock, so the notification cannot slip in between their check and their wait.
+        std::lock_guard lock(m_sleep_mutex);
+        ++m_queued;
+    }
+    m_work_available.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock lock(m_sleep_mutex);
+    m_idle.wait(lock, [this] { return m_pending.load() == 0; });
+}
+
+bool ThreadPool::try_pop(unsigned index, std::function<void()>& task) {
+    auto& worker = *m_workers[index];
+    std::lock_guard lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    --m_queued;
+    return true;
+}
+
+bool ThreadPool::try_steal(unsigned thief, std::function<void()>& task) {
+    for (std::size_t offset = 1; offset < m_workers.size(); ++offset) {
+        auto& victim = *m_workers[(thief + offset) % m_workers.size()];
+        std::lock_guard lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        --m_queued;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run_worker(unsigned index) {
+    s_current_pool = this;
+    s_current_worker_index = static_cast<int>(index);
+
+    std::function<void()> task;
+    while (true) {
+        if (try_pop(index, task) || try_steal(index, task)) {
+            task();
+            task = nullptr;
+            if (m_pending.fetch_sub(1) == 1) {
+                std::lock_guard lock(m_sleep_mutex);
+                m_idle.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_work_available.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+        if (m_stopping && m_queued.load() == 0)
+            return;
+    }
+}
+
+}
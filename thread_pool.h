@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FPC {
+
+// A fixed set of worker threads, each with its own task queue. Workers take their newest task first and, once their own
+// queue runs dry, steal the oldest task from another worker. Tasks submitted by a worker go to that worker's queue.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task, including those submitted by other tasks meanwhile, has finished.
+    void wait_idle();
+
+    unsigned get_thread_count() const { return static_cast<unsigned>(m_workers.size()); }
+    // The index of the worker running the calling thread in this pool, or -1 if it is not one of them.
+    int get_current_worker_index() const;
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void run_worker(unsigned index);
+    bool try_pop(unsigned index, std::function<void()>& task);
+    bool try_steal(unsigned thief, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<unsigned> m_next_queue {0};
+    // Tasks that sit in a queue, and tasks that have been submitted but not yet finished.
+    std::atomic<std::ptrdiff_t> m_queued {0};
+    std::atomic<std::size_t> m_pending {0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_idle;
+    bool m_stopping = false;
+};
+
+}
@@ -0,0 +1,209 @@
+#include "transposition_table.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+namespace FPC {
+
+namespace {
+
+// Layout of the data word.
+constexpr int s_depth_shift = 32;
+constexpr int s_bound_shift = 40;
+constexpr int s_generation_shift = 42;
+constexpr std::uint64_t s_generation_mask = 0x3f;
+// Set in every stored entry, so that an empty slot never verifies.
+constexpr std::uint64_t s_occupied_bit = std::uint64_t(1) << 48;
+
+std::uint64_t pack_scores(const std::array<int, 4>& scores) {
+    std::uint64_t packed = 0;
+    for (int i = 0; i < 4; ++i) {
+        const auto clamped = std::clamp(scores[i], int(std::numeric_limits<std::int16_t>::min()), int(std::numeric_limits<std::int16_t>::max()));
+        packed |= std::uint64_t(std::uint16_t(clamped)) << (16 * i);
+    }
+    return packed;
+}
+
+std::array<int, 4> unpack_scores(std::uint64_t packed) {
+    std::array<int, 4> scores {};
+    for (int i = 0; i < 4; ++i)
+        scores[i] = std::int16_t(std::uint16_t(packed >> (16 * i)));
+    return scores;
+}
+
+int depth_of(std::uint64_t data) {
+    return (data >> s_depth_shift) & 0xff;
+}
+
+int generation_of(std::uint64_t data) {
+    return (data >> s_generation_shift) & s_generation_mask;
+}
+
+}
+
+TranspositionTable::TranspositionTable(std::size_t size_in_megabytes, ReplacementPolicy policy)
+    : m_policy(policy) {
+    resize(size_in_megabytes);
+}
+
+void TranspositionTable::resize(std::size_t size_in_megabytes) {
+    m_bucket_count = std::max<std::size_t>(1, size_in_megabytes * 1024 * 1024 / sizeof(Bucket));
+    m_buckets = std::make_unique<Bucket[]>(m_bucket_count);
+    m_generation = 0;
+}
+
+void TranspositionTable::clear() {
+    for (std::size_t i = 0; i < m_bucket_count; ++i) {
+        for (auto& slot : m_buckets[i].slots) {
+            slot.check.store(0, std::memory_order_relaxed);
+            slot.scores.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    m_generation = 0;
+}
+
+void TranspositionTable::new_search() {
+    m_generation = (m_generation + 1) & s_generation_mask;
+}
+
+TranspositionTable::Bucket& TranspositionTable::bucket_for(std::uint64_t key) const {
+    // Maps the key onto [0, m_bucket_count) without requiring a power-of-two table size.
+    return m_buckets[static_cast<std::size_t>((static_cast<unsigned __int128>(key) * m_bucket_count) >> 64)];
+}
+
+TranspositionTable::Counters& TranspositionTable::counters_for_this_thread() const {
+    static thread_local const std::size_t stripe = std::hash<std::thread::id> {}(std::this_thread::get_id());
+    return m_counters[stripe % m_counters.size()];
+}
+
+void TranspositionTable::prefetch(std::uint64_t key) const {
+    __builtin_prefetch(&bucket_for(key));
+}
+
+std::optional<TranspositionEntry> TranspositionTable::probe(std::uint64_t key) const {
+    auto& counters = counters_for_this_thread();
+    counters.probes.fetch_add(1, std::memory_order_relaxed);
+    for (const auto& slot : bucket_for(key).slots) {
+        const auto scores = slot.scores.load(std::memory_order_relaxed);
+        const auto data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.check.load(std::memory_order_relaxed) ^ scores ^ data) != key || !(data & s_occupied_bit))
+            continue;
+
+        counters.hits.fetch_add(1, std::memory_order_relaxed);
+        TranspositionEntry entry {};
+        entry.scores = unpack_scores(scores);
+        entry.best_move = Move::from_raw(static_cast<std::uint32_t>(data));
+        entry.depth = depth_of(data);
+        entry.bound = static_cast<Bound>((data >> s_bound_shift) & 0x3);
+        return entry;
+    }
+    return std::nullopt;
+}
+
+void TranspositionTable::store(std::uint64_t key, const TranspositionEntry& entry) {
+    auto& counters = counters_for_this_thread();
+    auto& slots = bucket_for(key).slots;
+
+    const auto scores = pack_scores(entry.scores);
+    const std::uint64_t depth = std::clamp(entry.depth, 0, 255);
+    const auto data = std::uint64_t(entry.best_move.raw()) | depth << s_depth_shift | std::uint64_t(entry.bound) << s_bound_shift | std::uint64_t(m_generation) << s_generation_shift | s_occupied_bit;
+
+    auto stored_key = [](const Slot& slot) {
+        return slot.check.load(std::memory_order_relaxed) ^ slot.scores.load(std::memory_order_relaxed) ^ slot.data.load(std::memory_order_relaxed);
+    };
+    auto age_of = [this](std::uint64_t slot_data) {
+        return (m_generation - generation_of(slot_data)) & s_generation_mask;
+    };
+
+    Slot* victim = nullptr;
+    for (auto& slot : slots) {
+        if (stored_key(slot) == key) {
+            victim = &slot;
+            break;
+        }
+    }
+
+    if (!victim) {
+        switch (m_policy) {
+            case ReplacementPolicy::AlwaysReplace: {
+                // An empty slot first, then whichever entry comes from the older search, then the shallower one.
+                auto staleness = [&](const Slot& slot) {
+                    const auto slot_data = slot.data.load(std::memory_order_relaxed);
+                    if (!(slot_data & s_occupied_bit))
+                        return std::numeric_limits<int>::max();
+                    return 256 * static_cast<int>(age_of(slot_data)) - depth_of(slot_data);
+                };
+                victim = staleness(slots[0]) >= staleness(slots[1]) ? &slots[0] : &slots[1];
+                break;
+            }
+            case ReplacementPolicy::DepthPreferred:
+                victim = depth_of(slots[0].data.load(std::memory_order_relaxed)) <= depth_of(slots[1].data.load(std::memory_order_relaxed)) ? &slots[0] : &slots[1];
+                if (depth_of(victim->data.load(std::memory_order_relaxed)) > entry.depth) {
+                    counters.rejected.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                break;
+            case ReplacementPolicy::AgedDepthPreferred: {
+                auto worth = [&](const Slot& slot) {
+                    const auto slot_data = slot.data.load(std::memory_order_relaxed);
+                    return depth_of(slot_data) - 8 * age_of(slot_data);
+                };
+                victim = worth(slots[0]) <= worth(slots[1]) ? &slots[0] : &slots[1];
+                break;
+            }
+        }
+        if (victim->data.load(std::memory_order_relaxed) != 0)
+            counters.collisions.fetch_add(1, std::memory_order_relaxed);
+    } else if (m_policy != ReplacementPolicy::AlwaysReplace && entry.bound != Bound::Exact) {
+        // Keep a deeper result for the same position from this search, unless the new one is exact.
+        const auto existing = victim->data.load(std::memory_order_relaxed);
+        if (age_of(existing) == 0 && depth_of(existing) > entry.depth) {
+            counters.rejected.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    counters.stores.fetch_add(1, std::memory_order_relaxed);
+    victim->check.store(key ^ scores ^ data, std::memory_order_relaxed);
+    victim->scores.store(scores, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+}
+
+TranspositionTable::Statistics TranspositionTable::get_statistics() const {
+    Statistics statistics {};
+    for (const auto& counters : m_counters) {
+        statistics.probes += counters.probes.load(std::memory_order_relaxed);
+        statistics.hits += counters.hits.load(std::memory_order_relaxed);
+        statistics.stores += counters.stores.load(std::memory_order_relaxed);
+        statistics.collisions += counters.collisions.load(std::memory_order_relaxed);
+        statistics.rejected += counters.rejected.load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
+
+void TranspositionTable::reset_statistics() {
+    for (auto& counters : m_counters) {
+        counters.probes.store(0, std::memory_order_relaxed);
+        counters.hits.store(0, std::memory_order_relaxed);
+        counters.stores.store(0, std::memory_order_relaxed);
+        counters.collisions.store(0, std::memory_order_relaxed);
+        counters.rejected.store(0, std::memory_order_relaxed);
+    }
+}
+
+int TranspositionTable::get_hashfull() const {
+    const auto sampled = std::min<std::size_t>(m_bucket_count, 500);
+    int used = 0;
+    for (std::size_t i = 0; i < sampled; ++i) {
+        for (const auto& slot : m_buckets[i].slots) {
+            const auto data = slot.data.load(std::memory_order_relaxed);
+            if (data != 0 && generation_of(data) == m_generation)
+                ++used;
+        }
+    }
+    return static_cast<int>(used * 1000 / (sampled * 2));
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "library.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace FPC {
+
+enum class Bound : std::uint8_t {
+    Exact,
+    Lower,
+    Upper
+};
+
+enum class ReplacementPolicy {
+    AlwaysReplace,       // New entries always go in, evicting the slot from the older search, or else the shallower one.
+    DepthPreferred,      // New entries only evict the shallowest slot, and only if they were searched at least as deep.
+    AgedDepthPreferred,  // New entries always go in, evicting the slot that is shallowest once entries from older searches are penalized.
+};
+
+struct TranspositionEntry {
+    // One score per player, in the same order as the 'Color' enum.
+    std::array<int, 4> scores {};
+    Move best_move {};
+    int depth = 0;
+    Bound bound = Bound::Exact;
+};
+
+// A fixed-size hash table of search results which any number of threads may probe and store into concurrently without locks.
+// Every slot is three words, and the first holds the key XORed with the other two. A slot torn by concurrent writers thus fails
+// verification and reads as a miss, rather than returning data belonging to another position.
+class TranspositionTable {
+public:
+    struct Statistics {
+        std::uint64_t probes = 0;
+        std::uint64_t hits = 0;
+        std::uint64_t stores = 0;
+        std::uint64_t collisions = 0; // Stores that evicted a different position.
+        std::uint64_t rejected = 0;   // Stores dropped by the replacement policy.
+    };
+
+    explicit TranspositionTable(std::size_t size_in_megabytes, ReplacementPolicy policy = ReplacementPolicy::AgedDepthPreferred);
+
+    // Neither of these may run concurrently with any other member function.
+    void resize(std::size_t size_in_megabytes);
+    void clear();
+
+    // Ages the stored entries, so that they are replaced first. Call once before each new search, while no other thread uses the table.
+    void new_search();
+
+    std::optional<TranspositionEntry> probe(std::uint64_t key) const;
+    void store(std::uint64_t key, const TranspositionEntry& entry);
+    void prefetch(std::uint64_t key) const;
+
+    void set_replacement_policy(ReplacementPolicy policy) { m_policy = policy; }
+    ReplacementPolicy get_replacement_policy() const { return m_policy; }
+    std::size_t get_bucket_count() const { return m_bucket_count; }
+    std::size_t get_size_in_bytes() const { return m_bucket_count * sizeof(Bucket); }
+
+    Statistics get_statistics() const;
+    void reset_statistics();
+    // How many slots were written during the current search, per mille, sampled from the first thousand slots.
+    int get_hashfull() const;
+
+private:
+    struct Slot {
+        std::atomic<std::uint64_t> check {0}; // The key XORed with 'scores' and 'data'.
+        std::atomic<std::uint64_t> scores {0};
+        std::atomic<std::uint64_t> data {0};  // Best move, depth, bound and generation.
+    };
+
+    struct alignas(64) Bucket {
+        std::array<Slot, 2> slots;
+    };
+
+    // The counters are striped over several cache lines so that threads do not keep stealing a single line from each other.
+    struct alignas(64) Counters {
+        std::atomic<std::uint64_t> probes {0};
+        std::atomic<std::uint64_t> hits {0};
+        std::atomic<std::uint64_t> stores {0};
+        std::atomic<std::uint64_t> collisions {0};
+        std::atomic<std::uint64_t> rejected {0};
+    };
+
+    Bucket& bucket_for(std::uint64_t key) const;
+    Counters& counters_for_this_thread() const;
+
+    std::unique_ptr<Bucket[]> m_buckets;
+    std::size_t m_bucket_count = 0;
+    ReplacementPolicy m_policy;
+    std::uint8_t m_generation = 0;
+    mutable std::array<Counters, 16> m_counters;
+};
+
+}